@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
-#include "gmap.h"
+#include <time.h>
+#include <unistd.h>
 #include "entry.h"
+#include "blotto_score.h"
+#include "blotto_pipeline.h"
+#include "tournament.h"
+#include "string_key.h"
 #include "string_util.h"
 
 #define MAX_ID 31
@@ -14,55 +20,94 @@ typedef struct _matchup{
 } matchup;
 
 // function declarations
-size_t hash29(const void *key);
-void *duplicate(const void *key);
-int compare_keys(const void *key1, const void *key2);
-void freer(void *key);
-void values_destroy(const void *, void *, void *);
-
+int play_tournament(const entry_store* entries, const int* weights, int n_fields, size_t nthreads);
 
 // =================================================================================
 // Main Functions
 // =================================================================================
 int main(int argc, char **argv)
 {
+    // options come before the battlefield values; -tournament plays every
+    // entry against every other instead of reading matchups, and -threads
+    // sets how many threads score (0, the default, for one per processor;
+    // 1 scores matchups one at a time on the main thread)
+    bool tournament = false;
+    size_t nthreads = 0;
+    int first_field = 1;
+    while(first_field < argc)
+    {
+        if(strcmp(argv[first_field], "-tournament") == 0)
+            tournament = true;
+        else if(strcmp(argv[first_field], "-threads") == 0 && first_field + 1 < argc)
+        {
+            // strtoul would take "-1" as the largest count there is
+            char* end;
+            const char* count = argv[++first_field];
+            nthreads = strtoul(count, &end, 10);
+            if(!isdigit((unsigned char)count[0]) || *end != '\0')
+            {
+                fprintf(stderr, "error: -threads needs a nonnegative integer, not %s\n", count);
+                return 1;
+            }
+        }
+        else
+            break;
+        first_field++;
+    }
+
     // check how many argc there are
     // "there will be at least one command line argument" => you mean ./Blotto ?
-    int n_fields = argc-1;
-    gmap* m = gmap_create(duplicate, compare_keys, hash29, freer);
-    int* nullptr = NULL;
+    int n_fields = argc-first_field;
+    if(n_fields < 1)
+    {
+        fprintf(stderr, "usage: %s [-tournament] [-threads count] weight...\n", argv[0]);
+        return 1;
+    }
+    // a per-run seed keeps crafted ids from all landing in one probe run
+    string_hash_set_seed((size_t)time(NULL));
     
     // read in battlefield values from standard input
     int arr[n_fields];
     for(int i = 0; i < n_fields; ++i)
-        arr[i] = atoi(argv[i+1]);
+        arr[i] = atoi(argv[i+first_field]);
+    // twice a player's score is the total weight plus or minus their margin
+    int64_t total_weight = 0;
+    for(int i = 0; i < n_fields; ++i)
+        total_weight += arr[i];
 
-    // store distributions
-    entry* temp = malloc(sizeof(entry));
-    *temp = entry_read(stdin, MAX_ID, n_fields);
-    while(!(temp->id == NULL && temp->distribution == NULL))
-    {
-        // if we reach the end of the file
-        if(strcmp(temp->id, "") == 0 && temp->distribution == NULL) break;
-
-        gmap_put(m, temp->id, temp->distribution);
-        //entry_destroy(temp);
-        // or just the key and not the distribution because we need it later?
-        free(temp->id);
-        *temp = entry_read(stdin, MAX_ID, n_fields);
-    }
-    if(temp->id == NULL && temp->distribution == NULL)
+    // read every entry first; each id becomes an index into one matrix of
+    // distributions, so matchups look up two rows and score them
+    line_reader* in = line_reader_create(STDIN_FILENO);
+    entry_store* entries = entry_store_create(MAX_ID, n_fields);
+    if(in == NULL || entries == NULL || !entry_store_read(entries, in))
     {
         fprintf(stderr, "error: something was wrong in the entry standard input\n");
-        entry_destroy(temp); // no point doing this bc id and distribution are already null ptrs
-        gmap_for_each(m, values_destroy, nullptr);
-        gmap_destroy(m);
-        free(temp);
+        entry_store_destroy(entries);
+        line_reader_destroy(in);
         return 1;
     }
-    entry_destroy(temp);
-    free(temp);
-    
+
+    if(tournament)
+    {
+        int status = play_tournament(entries, arr, n_fields, nthreads);
+        entry_store_destroy(entries);
+        line_reader_destroy(in);
+        return status;
+    }
+
+    if(nthreads != 1)
+    {
+        char missing[MAX_ID+1];
+        blotto_pipeline_status status = blotto_pipeline_run(in, entries, MAX_ID, arr, n_fields, nthreads, stdout, missing);
+        if(status == BLOTTO_PIPELINE_MISSING)
+            fprintf(stderr, "error: player %s was not given\n", missing);
+        else if(status == BLOTTO_PIPELINE_NO_MEMORY)
+            fprintf(stderr, "error: could not allocate the matchups\n");
+        entry_store_destroy(entries);
+        line_reader_destroy(in);
+        return status == BLOTTO_PIPELINE_DONE ? 0 : 1;
+    }
+
     // store pointers to the strings
     matchup match;
     match.id1 = malloc((MAX_ID+1) * sizeof(char));
@@ -70,121 +115,82 @@ int main(int argc, char **argv)
     
     // two IDs, one empty space in between. not included: null terminator
     int length = MAX_ID*2+1;
-    char line[length];
-    read_line(line,length);
+    char line[length + 1];
+    line_reader_read(in, line, length);
     
-    // make room to deep copy distribution arrays
-    int* value1;
-    int* value2;
-
     while(sscanf(line, "%31s %31s", match.id1, match.id2) == 2)
     {
-        if(gmap_contains_key(m, match.id1)) value1 = (int*)gmap_get(m, match.id1);
-        else
+        // one hash and one probe per player
+        size_t index1 = entry_store_find(entries, match.id1);
+        size_t index2 = entry_store_find(entries, match.id2);
+        if(index1 == ENTRY_STORE_MISSING || index2 == ENTRY_STORE_MISSING)
         {
-            fprintf(stderr, "error: player %s was not given\n", match.id1);
+            fprintf(stderr, "error: player %s was not given\n",
+                    index1 == ENTRY_STORE_MISSING ? match.id1 : match.id2);
             free(match.id1);
             free(match.id2);
-            gmap_for_each(m, values_destroy, nullptr);
-            gmap_destroy(m);
-            return 1;
-        }
-        if(gmap_contains_key(m, match.id2)) value2 = (int*)gmap_get(m, match.id2);
-        else
-        {
-            fprintf(stderr, "error: player %s was not given\n", match.id2);
-            free(match.id1);
-            free(match.id2);
-            gmap_for_each(m, values_destroy, nullptr);
-            gmap_destroy(m);
-            return 1;
-        }
-
-        // check for NULL values to avoid segmentation faults
-        if(value1 == NULL || value2 == NULL)
-        {
-            fprintf(stderr, "error: key does not have associated value\n");
-            free(match.id1);
-            free(match.id2);
-            gmap_for_each(m, values_destroy, nullptr);
-            gmap_destroy(m);
+            entry_store_destroy(entries);
+            line_reader_destroy(in);
             return 1;
         }
 
-        // gmap_get will return an int array
-        double total1 = 0;
-        double total2 = 0;
-        for(size_t ifields = 0; ifields < n_fields; ++ifields)
-        {
-            if(value1[ifields] > value2[ifields]) total1 += arr[ifields];
-            else if(value1[ifields] < value2[ifields]) total2 += arr[ifields];
-            else
-            {
-                total1 += (double)arr[ifields]/2;
-                total2 += (double)arr[ifields]/2;
-            }
-        }
+        const int* value1 = entry_store_row(entries, index1);
+        const int* value2 = entry_store_row(entries, index2);
+        int64_t margin = blotto_margin(value1, value2, arr, n_fields);
+        double total1 = (total_weight + margin) / 2.0;
+        double total2 = (total_weight - margin) / 2.0;
 
         // print the winner first
-        if(total1 >= total2)
+        if(margin >= 0)
           printf("%s %.1lf - %s %.1lf\n", match.id1, total1, match.id2, total2);
         else
           printf("%s %.1lf - %s %.1lf\n", match.id2, total2, match.id1, total1);
 
         // read in next line
-        read_line(line,length);
+        line_reader_read(in, line, length);
     }
 
     // free memory
     free(match.id1);
     free(match.id2);
-    gmap_for_each(m, values_destroy, nullptr);
-    gmap_destroy(m);
+    entry_store_destroy(entries);
+    line_reader_destroy(in);
     return 0;
 }
 
 
 // =================================================================================
-// Functions to store in gmap and Helper functions
+// Helper Functions
 // =================================================================================
-size_t hash29(const void *key)
+
+/*
+ * Plays a round-robin tournament among the entries in the given store and
+ * prints the ranking.  An id given more than once plays with its last
+ * distribution, as in matchups.  Returns the exit status for main.
+ */
+int play_tournament(const entry_store* entries, const int* weights, int n_fields, size_t nthreads)
 {
-  const char *s = key;
-  size_t sum = 0;
-  size_t factor = 29;
-  while (s != NULL && *s != '\0')
+    size_t n = entry_store_size(entries);
+    tournament_standing* standings = malloc((n + 1) * sizeof(tournament_standing));
+    if(standings == NULL || !tournament_run(entry_store_matrix(entries), n, weights, n_fields, nthreads, standings))
     {
-      sum += *s * factor;
-      s++;
-      factor *= 29;
+        fprintf(stderr, "error: could not allocate the tournament\n");
+        free(standings);
+        return 1;
     }
+    tournament_rank(standings, n);
 
-  return sum;
-}
-
-void *duplicate(const void *key)
-{
-  char *s = malloc(strlen(key) + 1);
-  if (s != NULL)
+    // entries with the same wins and points share a rank
+    printf("rank id wins ties losses points\n");
+    size_t rank = 0;
+    for(size_t r = 0; r < n; r++)
     {
-      strcpy(s, key);
+        tournament_standing* s = &standings[r];
+        if(r == 0 || 2 * s->wins + s->ties != 2 * s[-1].wins + s[-1].ties || s->points2 != s[-1].points2)
+            rank = r + 1;
+        printf("%zu %s %zu %zu %zu %.1lf\n", rank, entry_store_id(entries, s->entry),
+               s->wins, s->ties, s->losses, s->points2 / 2.0);
     }
-  return s;
-}
-
-int compare_keys(const void *key1, const void *key2)
-{
-  return strcmp(key1, key2);
-}
-
-void freer(void *key)
-{
-    free(key);
-    return;
+    free(standings);
+    return 0;
 }
-
-void values_destroy(const void *key, void *value, void * nullptr)
-{
-  free(value);
-  return;
-}
\ No newline at end of file
@@ -0,0 +1,348 @@
+/* CPSC223 Fall 2022 hw4
+ * Blotto matchups in a pipeline: a reader thread splits lines into ids a
+ * batch at a time, workers score whole batches, and the calling thread
+ * writes the batches back out in input order.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "blotto_pipeline.h"
+#include "blotto_score.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+// matchups in a batch
+#define BLOTTO_PIPELINE_BATCH 1024
+
+// batches in flight per worker, so a worker never waits on the reader or
+// the writer while another batch could be scored
+#define BLOTTO_PIPELINE_DEPTH 2
+
+// the most characters %.1lf writes for a score: half an int64_t has at
+// most 19 digits, then a sign, a point and a tenth
+#define BLOTTO_PIPELINE_SCORE_CHARS 24
+
+// room for one result line and its null terminator
+#define BLOTTO_PIPELINE_LINE(max_id) (2 * (size_t)(max_id) + 2 * BLOTTO_PIPELINE_SCORE_CHARS + 7)
+
+// one batch of matchups and, once scored, their results
+typedef struct _blotto_pipeline_batch
+{
+    // number of matchups
+    size_t n;
+    // the ids of matchup i are at 2i and 2i+1, each in max_id+1 chars
+    char* ids;
+    // the results, out_len chars, for the matchups before any missing player
+    char* out;
+    size_t out_len;
+    bool scored;
+    // whether a matchup named a player not in the store, and which
+    bool missed;
+    char missing[ENTRY_STORE_MAX_ID + 1];
+} blotto_pipeline_batch;
+
+// the state shared by the threads of one run; the counts of batches only
+// grow, and batch k is in slot k % nbatches
+typedef struct _blotto_pipeline
+{
+    line_reader* in;
+    const entry_store* entries;
+    int max_id;
+    const int* weights;
+    int battlefields;
+    int64_t total_weight;
+    blotto_pipeline_batch* batches;
+    size_t nbatches;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    // batches filled by the reader, handed to workers, and written
+    size_t read;
+    size_t claimed;
+    size_t written;
+    // the reader found the end of the matchups
+    bool read_all;
+    // the writer is done, so the other threads should stop
+    bool stopped;
+} blotto_pipeline;
+
+// helper function declarations
+static void* blotto_pipeline_read(void* arg);
+static void* blotto_pipeline_score(void* arg);
+static void blotto_pipeline_score_batch(blotto_pipeline* p, blotto_pipeline_batch* b);
+static bool blotto_pipeline_split(const char* line, int max_id, char* id1, char* id2);
+
+blotto_pipeline_status blotto_pipeline_run(line_reader *in, const entry_store *entries, int max_id,
+                                           const int *weights, int battlefields, size_t nthreads,
+                                           FILE *out, char *missing)
+{
+    // more workers than processors would only add batches in flight
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t most = online > 0 ? (size_t)online : 1;
+    if (nthreads == 0 || nthreads > most)
+        nthreads = most;
+
+    blotto_pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.in = in;
+    p.entries = entries;
+    p.max_id = max_id;
+    p.weights = weights;
+    p.battlefields = battlefields;
+    for (int f = 0; f < battlefields; f++)
+        p.total_weight += weights[f];
+
+    // every batch is allocated up front, so once results are written
+    // nothing can fail
+    size_t id_chars = 2 * (size_t)(max_id + 1) * BLOTTO_PIPELINE_BATCH;
+    size_t out_chars = BLOTTO_PIPELINE_LINE(max_id) * BLOTTO_PIPELINE_BATCH;
+    p.nbatches = BLOTTO_PIPELINE_DEPTH * nthreads + 2;
+    p.batches = calloc(p.nbatches, sizeof(blotto_pipeline_batch));
+    bool allocated = p.batches != NULL;
+    for (size_t k = 0; allocated && k < p.nbatches; k++)
+    {
+        p.batches[k].ids = malloc(id_chars);
+        p.batches[k].out = malloc(out_chars);
+        allocated = p.batches[k].ids != NULL && p.batches[k].out != NULL;
+    }
+
+    pthread_t* workers = malloc(nthreads * sizeof(pthread_t));
+    bool* started = malloc(nthreads * sizeof(bool));
+    allocated = allocated && workers != NULL && started != NULL;
+
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.changed, NULL);
+    pthread_t reader;
+    if (!allocated || pthread_create(&reader, NULL, blotto_pipeline_read, &p) != 0)
+    {
+        free(workers);
+        free(started);
+        for (size_t k = 0; p.batches != NULL && k < p.nbatches; k++)
+        {
+            free(p.batches[k].ids);
+            free(p.batches[k].out);
+        }
+        free(p.batches);
+        pthread_mutex_destroy(&p.lock);
+        pthread_cond_destroy(&p.changed);
+        return BLOTTO_PIPELINE_NO_MEMORY;
+    }
+    size_t nstarted = 0;
+    for (size_t w = 0; w < nthreads; w++)
+    {
+        started[w] = pthread_create(&workers[w], NULL, blotto_pipeline_score, &p) == 0;
+        nstarted += started[w];
+    }
+
+    // write the batches in order, scoring them here if no worker started
+    blotto_pipeline_status status = BLOTTO_PIPELINE_DONE;
+    pthread_mutex_lock(&p.lock);
+    while (true)
+    {
+        blotto_pipeline_batch* b = &p.batches[p.written % p.nbatches];
+        if (nstarted == 0 && p.claimed < p.read)
+        {
+            p.claimed++;
+            pthread_mutex_unlock(&p.lock);
+            blotto_pipeline_score_batch(&p, b);
+            pthread_mutex_lock(&p.lock);
+            b->scored = true;
+        }
+        if (p.written == p.read && p.read_all)
+            break;
+        if (p.written == p.read || !b->scored)
+        {
+            pthread_cond_wait(&p.changed, &p.lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&p.lock);
+        fwrite(b->out, 1, b->out_len, out);
+        pthread_mutex_lock(&p.lock);
+        if (b->missed)
+        {
+            strcpy(missing, b->missing);
+            status = BLOTTO_PIPELINE_MISSING;
+            break;
+        }
+        p.written++;
+        pthread_cond_broadcast(&p.changed);
+    }
+    p.stopped = true;
+    pthread_cond_broadcast(&p.changed);
+    pthread_mutex_unlock(&p.lock);
+
+    // the reader may be waiting for input past a missing player; it can
+    // only be cancelled there, and has nothing to clean up
+    pthread_cancel(reader);
+    pthread_join(reader, NULL);
+    for (size_t w = 0; w < nthreads; w++)
+    {
+        if (started[w])
+            pthread_join(workers[w], NULL);
+    }
+    free(workers);
+    free(started);
+    for (size_t k = 0; k < p.nbatches; k++)
+    {
+        free(p.batches[k].ids);
+        free(p.batches[k].out);
+    }
+    free(p.batches);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.changed);
+    return status;
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+
+/*
+ * Fills batches from the reader until the first line without two ids,
+ * waiting for a free slot before each.  A batch is handed off early when
+ * the next line is not yet available, so results from streaming input are
+ * not held back.  The thread can be cancelled only while waiting for
+ * input.
+ */
+static void* blotto_pipeline_read(void* arg)
+{
+    blotto_pipeline* p = arg;
+    size_t id_size = p->max_id + 1;
+    // two ids, one space in between, as in Blotto's own loop
+    int length = p->max_id * 2 + 1;
+    char line[length + 1];
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    bool more = true;
+    while (more)
+    {
+        pthread_mutex_lock(&p->lock);
+        while (!p->stopped && p->read - p->written == p->nbatches)
+            pthread_cond_wait(&p->changed, &p->lock);
+        bool stopped = p->stopped;
+        pthread_mutex_unlock(&p->lock);
+        if (stopped)
+            break;
+
+        // the writer has finished with this slot, so nothing else uses it
+        blotto_pipeline_batch* b = &p->batches[p->read % p->nbatches];
+        size_t n = 0;
+        while (n < BLOTTO_PIPELINE_BATCH)
+        {
+            bool ready = line_reader_ready(p->in);
+            if (n > 0 && !ready)
+                break;
+            if (!ready)
+                pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            line_reader_read(p->in, line, length);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            char* ids = b->ids + 2 * n * id_size;
+            if (!blotto_pipeline_split(line, p->max_id, ids, ids + id_size))
+            {
+                more = false;
+                break;
+            }
+            n++;
+        }
+        b->n = n;
+        b->out_len = 0;
+        b->scored = false;
+        b->missed = false;
+
+        pthread_mutex_lock(&p->lock);
+        if (n > 0)
+            p->read++;
+        p->read_all = !more;
+        pthread_cond_broadcast(&p->changed);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Claims and scores batches until there are no more or the writer stops.
+ */
+static void* blotto_pipeline_score(void* arg)
+{
+    blotto_pipeline* p = arg;
+    pthread_mutex_lock(&p->lock);
+    while (true)
+    {
+        if (p->stopped || (p->claimed == p->read && p->read_all))
+            break;
+        if (p->claimed == p->read)
+        {
+            pthread_cond_wait(&p->changed, &p->lock);
+            continue;
+        }
+        blotto_pipeline_batch* b = &p->batches[p->claimed++ % p->nbatches];
+        pthread_mutex_unlock(&p->lock);
+        blotto_pipeline_score_batch(p, b);
+        pthread_mutex_lock(&p->lock);
+        b->scored = true;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/*
+ * Scores the matchups of the given batch and formats their results,
+ * stopping at the first with a player not in the store.
+ */
+static void blotto_pipeline_score_batch(blotto_pipeline* p, blotto_pipeline_batch* b)
+{
+    size_t id_size = p->max_id + 1;
+    size_t line_size = BLOTTO_PIPELINE_LINE(p->max_id);
+    for (size_t i = 0; i < b->n; i++)
+    {
+        const char* id1 = b->ids + 2 * i * id_size;
+        const char* id2 = id1 + id_size;
+        size_t index1 = entry_store_find(p->entries, id1);
+        size_t index2 = entry_store_find(p->entries, id2);
+        if (index1 == ENTRY_STORE_MISSING || index2 == ENTRY_STORE_MISSING)
+        {
+            strcpy(b->missing, index1 == ENTRY_STORE_MISSING ? id1 : id2);
+            b->missed = true;
+            return;
+        }
+
+        int64_t margin = blotto_margin(entry_store_row(p->entries, index1), entry_store_row(p->entries, index2),
+                                       p->weights, p->battlefields);
+        double total1 = (p->total_weight + margin) / 2.0;
+        double total2 = (p->total_weight - margin) / 2.0;
+
+        // the winner first
+        char* line = b->out + b->out_len;
+        if (margin >= 0)
+            b->out_len += snprintf(line, line_size, "%s %.1lf - %s %.1lf\n", id1, total1, id2, total2);
+        else
+            b->out_len += snprintf(line, line_size, "%s %.1lf - %s %.1lf\n", id2, total2, id1, total1);
+    }
+}
+
+/*
+ * Splits the given line into two ids exactly as sscanf with the format
+ * "%31s %31s" (for a max_id of 31) would, so an id longer than max_id
+ * runs on into the next.  Returns false if the line does not hold two.
+ */
+static bool blotto_pipeline_split(const char* line, int max_id, char* id1, char* id2)
+{
+    char* ids[2] = {id1, id2};
+    for (int k = 0; k < 2; k++)
+    {
+        while (isspace((unsigned char)*line))
+            line++;
+        if (*line == '\0')
+            return false;
+        int len = 0;
+        while (len < max_id && *line != '\0' && !isspace((unsigned char)*line))
+            ids[k][len++] = *line++;
+        ids[k][len] = '\0';
+    }
+    return true;
+}
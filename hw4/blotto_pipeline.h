@@ -0,0 +1,54 @@
+#ifndef __BLOTTO_PIPELINE_H__
+#define __BLOTTO_PIPELINE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "entry.h"
+#include "string_util.h"
+
+/**
+ * How a run of matchups ended.
+ */
+typedef enum blotto_pipeline_status
+{
+    // every matchup was scored and written
+    BLOTTO_PIPELINE_DONE,
+    // a matchup named a player that was not given; the ones before it
+    // were written
+    BLOTTO_PIPELINE_MISSING,
+    // nothing was written because there was an allocation error
+    BLOTTO_PIPELINE_NO_MEMORY
+} blotto_pipeline_status;
+
+/**
+ * Reads matchups, one "id1 id2" per line up to the first line without two
+ * ids, scores each, and writes one result line per matchup, as Blotto
+ * does one matchup at a time: "winner score - loser score", the first
+ * player taken as the winner of a tie.  A reader thread splits the input
+ * into batches of ids, worker threads look the ids up and score and
+ * format whole batches, and the calling thread writes the batches in
+ * input order, so the output is the same as from the one-at-a-time loop.
+ * Batches are handed on as soon as the input runs dry, so results from
+ * streaming input appear as their lines arrive.  After a missing player
+ * the rest of the input is left unread, and the reader may only be
+ * destroyed.
+ *
+ * @param in a pointer to a reader positioned at the first matchup, non-NULL
+ * @param entries a pointer to a store of entries, non-NULL
+ * @param max_id the most characters of an id to read, at most
+ * ENTRY_STORE_MAX_ID
+ * @param weights a pointer to an array of battlefields weights, non-NULL
+ * @param battlefields the number of battlefields in each entry
+ * @param nthreads the number of worker threads, or 0 for one per online
+ * processor; no more than one per online processor are used
+ * @param out a pointer to the stream to write results to, non-NULL
+ * @param missing a string with space for max_id+1 characters, where the
+ * missing player's id is saved if the status is BLOTTO_PIPELINE_MISSING
+ * @return how the run ended
+ */
+blotto_pipeline_status blotto_pipeline_run(line_reader *in, const entry_store *entries, int max_id,
+                                           const int *weights, int battlefields, size_t nthreads,
+                                           FILE *out, char *missing);
+
+#endif
@@ -0,0 +1,68 @@
+/* CPSC223 Fall 2022 hw4
+ * Scoring of Blotto matchups: the margin of one distribution over another,
+ * eight battlefields at a time with AVX2 compare masks where available.
+ */
+
+#include "blotto_score.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BLOTTO_SCORE_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef BLOTTO_SCORE_AVX2
+static int64_t blotto_margin_avx2(const int* d1, const int* d2, const int* weights, size_t n);
+#endif
+
+int64_t blotto_margin(const int *d1, const int *d2, const int *weights, size_t n)
+{
+#ifdef BLOTTO_SCORE_AVX2
+    // the check reads a flag the runtime set at startup
+    if (__builtin_cpu_supports("avx2"))
+        return blotto_margin_avx2(d1, d2, weights, n);
+#endif
+    return blotto_margin_scalar(d1, d2, weights, n);
+}
+
+int64_t blotto_margin_scalar(const int *d1, const int *d2, const int *weights, size_t n)
+{
+    int64_t margin = 0;
+    for (size_t i = 0; i < n; i++)
+        margin += ((d1[i] > d2[i]) - (d1[i] < d2[i])) * (int64_t)weights[i];
+    return margin;
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+
+#ifdef BLOTTO_SCORE_AVX2
+/*
+ * The margin, eight battlefields per step.  The weights of the battlefields
+ * each player wins are selected with compare masks and widened to 64 bits
+ * before they are added, so no sum can overflow.
+ */
+__attribute__((target("avx2")))
+static int64_t blotto_margin_avx2(const int* d1, const int* d2, const int* weights, size_t n)
+{
+    __m256i wins1 = _mm256_setzero_si256();
+    __m256i wins2 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(d1 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(d2 + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(weights + i));
+        __m256i won1 = _mm256_and_si256(_mm256_cmpgt_epi32(a, b), w);
+        __m256i won2 = _mm256_and_si256(_mm256_cmpgt_epi32(b, a), w);
+        wins1 = _mm256_add_epi64(wins1, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(won1)));
+        wins1 = _mm256_add_epi64(wins1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(won1, 1)));
+        wins2 = _mm256_add_epi64(wins2, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(won2)));
+        wins2 = _mm256_add_epi64(wins2, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(won2, 1)));
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_sub_epi64(wins1, wins2));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + blotto_margin_scalar(d1 + i, d2 + i, weights + i, n - i);
+}
+#endif
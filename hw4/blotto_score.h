@@ -0,0 +1,36 @@
+#ifndef __BLOTTO_SCORE_H__
+#define __BLOTTO_SCORE_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * Returns the margin of one Blotto distribution over another: the total
+ * weight of the battlefields where the first puts more units than the
+ * second, minus the total weight of those where the second puts more.
+ * With T the sum of the weights, the first player scores (T + margin) / 2
+ * and the second (T - margin) / 2, ties splitting a battlefield's weight
+ * evenly; the sums are exact because everything before the final halving
+ * is integer arithmetic.  Uses AVX2 when the processor has it.
+ *
+ * @param d1 a pointer to an array of n unit counts, non-NULL
+ * @param d2 a pointer to an array of n unit counts, non-NULL
+ * @param weights a pointer to an array of n battlefield weights, non-NULL
+ * @param n the number of battlefields
+ * @return the margin of d1 over d2
+ */
+int64_t blotto_margin(const int *d1, const int *d2, const int *weights, size_t n);
+
+/**
+ * Returns the same margin as blotto_margin, one battlefield at a time and
+ * without branching on the comparisons.  Works on any processor.
+ *
+ * @param d1 a pointer to an array of n unit counts, non-NULL
+ * @param d2 a pointer to an array of n unit counts, non-NULL
+ * @param weights a pointer to an array of n battlefield weights, non-NULL
+ * @param n the number of battlefields
+ * @return the margin of d1 over d2
+ */
+int64_t blotto_margin_scalar(const int *d1, const int *d2, const int *weights, size_t n);
+
+#endif
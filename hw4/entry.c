@@ -7,10 +7,50 @@
 #include "entry.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 
+#include "gmap_typed.h"
+#include "string_key.h"
+
 typedef enum parse_state {ID, DISTRIBUTION} parse_state;
 
+// the result of parsing one line for entry_read_all
+typedef enum parse_result {PARSED, END_OF_INPUT, INVALID} parse_result;
+
+// an id held by value; the unused tail is zero
+typedef struct entry_store_key
+{
+  char s[ENTRY_STORE_MAX_ID + 1];
+} entry_store_key;
+
+// the seeded string hash, so crafted ids cannot all collide
+static inline size_t entry_store_hash(entry_store_key k)
+{
+  return hash_string_wy(k.s);
+}
+
+static inline int entry_store_equal(entry_store_key a, entry_store_key b)
+{
+  return memcmp(a.s, b.s, sizeof(a.s)) == 0;
+}
+
+GMAP_DEFINE(entry_index_map, entry_store_key, size_t, entry_store_hash, entry_store_equal)
+
+struct _entry_store
+{
+  // id -> index
+  entry_index_map *index;
+  // rows and ids in index order; n is the number of distinct ids
+  entry_list entries;
+};
+
+static bool entry_store_key_make(const char *id, entry_store_key *key);
+static void entry_store_mark(const entry_store_key *key, size_t *index, void *arg);
+static void entry_store_renumber(const entry_store_key *key, size_t *index, void *arg);
+static parse_result entry_parse(const char *line, size_t len, int max_id, int battlefields,
+                                char *id, int *distribution, size_t *consumed);
+
 entry entry_read(FILE *in, int max_id, int battlefields)
 {
   entry result;
@@ -142,3 +182,306 @@ void entry_destroy(entry *e)
       e->distribution = NULL;
     }
 }
+
+bool entry_read_all(line_reader *in, int max_id, int battlefields, entry_list *list)
+{
+  list->n = 0;
+  list->capacity = 0;
+  list->max_id = max_id;
+  list->battlefields = battlefields;
+  list->ids = NULL;
+  list->distributions = NULL;
+
+  while (true)
+    {
+      if (list->n == list->capacity)
+        {
+          size_t capacity = list->capacity * 2 + 64;
+          char *ids = realloc(list->ids, capacity * (max_id + 1));
+          if (ids != NULL)
+            {
+              list->ids = ids;
+            }
+          int *distributions = realloc(list->distributions, capacity * battlefields * sizeof(int));
+          if (distributions != NULL)
+            {
+              list->distributions = distributions;
+            }
+          if (ids == NULL || distributions == NULL)
+            {
+              return false;
+            }
+          list->capacity = capacity;
+        }
+
+      size_t len;
+      const char *line = line_reader_peek(in, &len);
+      if (line == NULL)
+        {
+          return false;
+        }
+
+      size_t consumed;
+      parse_result result = entry_parse(line, len, max_id, battlefields,
+                                        ENTRY_LIST_ID(list, list->n),
+                                        ENTRY_LIST_DISTRIBUTION(list, list->n),
+                                        &consumed);
+      if (result == INVALID)
+        {
+          return false;
+        }
+      line_reader_advance(in, consumed);
+      if (result == END_OF_INPUT)
+        {
+          return true;
+        }
+      list->n++;
+    }
+}
+
+void entry_list_destroy(entry_list *list)
+{
+  if (list != NULL)
+    {
+      free(list->ids);
+      list->ids = NULL;
+      free(list->distributions);
+      list->distributions = NULL;
+      list->n = 0;
+      list->capacity = 0;
+    }
+}
+
+/**
+ * Parses the entry at the start of the given line (as returned by
+ * line_reader_peek) into id and distribution, with the same rules as
+ * entry_read, and stores the number of characters it takes up in
+ * consumed.  Like entry_read, the entry ends at a newline or carriage
+ * return, and the character after a carriage return is consumed too.
+ */
+static parse_result entry_parse(const char *line, size_t len, int max_id, int battlefields,
+                                char *id, int *distribution, size_t *consumed)
+{
+  size_t stop = len > 0 && line[len - 1] == '\n' ? len - 1 : len;
+  const char *cr = memchr(line, '\r', stop);
+  if (cr != NULL)
+    {
+      stop = cr - line;
+      *consumed = stop + 2 <= len ? stop + 2 : len;
+    }
+  else
+    {
+      *consumed = len;
+    }
+
+  // the id runs to the first comma, or the whole entry if there is none
+  const char *comma = memchr(line, ',', stop);
+  size_t id_end = comma == NULL ? stop : (size_t)(comma - line);
+  for (size_t i = 0; i < id_end; i++)
+    {
+      if (isspace((unsigned char)line[i]))
+        {
+          return INVALID;
+        }
+    }
+  size_t id_len = id_end < (size_t)max_id ? id_end : (size_t)max_id;
+  memcpy(id, line, id_len);
+  id[id_len] = '\0';
+
+  // each field is a run of digits ended by a comma or the end of the
+  // entry; only the last field may be empty
+  int curr_bf = 0;
+  if (battlefields > 0)
+    {
+      distribution[0] = 0;
+    }
+  if (comma != NULL)
+    {
+      if (battlefields < 1)
+        {
+          return INVALID;
+        }
+      const char *p = comma + 1;
+      const char *end = line + stop;
+      while (true)
+        {
+          const char *start = p;
+          unsigned int value = 0;
+          unsigned int digit;
+          while (p < end && (digit = (unsigned char)*p - '0') < 10)
+            {
+              value = value * 10 + digit;
+              p++;
+            }
+          distribution[curr_bf] = (int)value;
+
+          if (p == end)
+            {
+              break;
+            }
+          if (*p != ',' || p == start || ++curr_bf >= battlefields)
+            {
+              return INVALID;
+            }
+          p++;
+        }
+    }
+
+  if (id_end == 0)
+    {
+      // empty id and no more than one field means end-of-input
+      return curr_bf > 0 ? INVALID : END_OF_INPUT;
+    }
+  return curr_bf == battlefields - 1 ? PARSED : INVALID;
+}
+
+entry_store *entry_store_create(int max_id, int battlefields)
+{
+  if (max_id < 1 || max_id > ENTRY_STORE_MAX_ID || battlefields < 1)
+    {
+      return NULL;
+    }
+
+  entry_store *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    {
+      return NULL;
+    }
+  s->index = entry_index_map_create();
+  if (s->index == NULL)
+    {
+      free(s);
+      return NULL;
+    }
+  s->entries.max_id = max_id;
+  s->entries.battlefields = battlefields;
+  return s;
+}
+
+bool entry_store_read(entry_store *s, line_reader *in)
+{
+  entry_list *list = &s->entries;
+  if (!entry_read_all(in, list->max_id, list->battlefields, list))
+    {
+      return false;
+    }
+
+  // map each id to the position it was last given at, then keep just
+  // those entries, moving each down to the next index, and renumber the
+  // map to match; moved holds each position's new index, or
+  // ENTRY_STORE_MISSING for an entry that is dropped
+  size_t *moved = malloc((list->n + 1) * sizeof(size_t));
+  if (moved == NULL || !entry_index_map_reserve(s->index, list->n))
+    {
+      free(moved);
+      return false;
+    }
+  for (size_t i = 0; i < list->n; i++)
+    {
+      entry_store_key key;
+      entry_store_key_make(ENTRY_LIST_ID(list, i), &key);
+      entry_index_map_put(s->index, key, i);
+      moved[i] = ENTRY_STORE_MISSING;
+    }
+  entry_index_map_for_each(s->index, entry_store_mark, moved);
+
+  size_t n = 0;
+  size_t row_bytes = list->battlefields * sizeof(int);
+  for (size_t i = 0; i < list->n; i++)
+    {
+      if (moved[i] == ENTRY_STORE_MISSING)
+        {
+          continue;
+        }
+      moved[i] = n;
+      if (n != i)
+        {
+          memcpy(ENTRY_LIST_ID(list, n), ENTRY_LIST_ID(list, i), list->max_id + 1);
+          memcpy(ENTRY_LIST_DISTRIBUTION(list, n), ENTRY_LIST_DISTRIBUTION(list, i), row_bytes);
+        }
+      n++;
+    }
+  entry_index_map_for_each(s->index, entry_store_renumber, moved);
+  free(moved);
+  list->n = n;
+  return true;
+}
+
+size_t entry_store_size(const entry_store *s)
+{
+  return s->entries.n;
+}
+
+size_t entry_store_find(const entry_store *s, const char *id)
+{
+  entry_store_key key;
+  if (!entry_store_key_make(id, &key))
+    {
+      return ENTRY_STORE_MISSING;
+    }
+  const size_t *index = entry_index_map_get_const(s->index, key);
+  return index == NULL ? ENTRY_STORE_MISSING : *index;
+}
+
+const char *entry_store_id(const entry_store *s, size_t index)
+{
+  return ENTRY_LIST_ID(&s->entries, index);
+}
+
+const int *entry_store_matrix(const entry_store *s)
+{
+  return s->entries.distributions;
+}
+
+const int *entry_store_row(const entry_store *s, size_t index)
+{
+  return ENTRY_LIST_DISTRIBUTION(&s->entries, index);
+}
+
+void entry_store_destroy(entry_store *s)
+{
+  if (s != NULL)
+    {
+      entry_index_map_destroy(s->index);
+      entry_list_destroy(&s->entries);
+      free(s);
+    }
+}
+
+/**
+ * Fills in the key for the given id, returning false if the id is too
+ * long to be in a store.
+ */
+static bool entry_store_key_make(const char *id, entry_store_key *key)
+{
+  memset(key->s, 0, sizeof(key->s));
+  size_t len = 0;
+  while (id[len] != '\0')
+    {
+      if (len == ENTRY_STORE_MAX_ID)
+        {
+          return false;
+        }
+      key->s[len] = id[len];
+      len++;
+    }
+  return true;
+}
+
+/**
+ * Marks the position in the given map value as one to keep.
+ */
+static void entry_store_mark(const entry_store_key *key, size_t *index, void *arg)
+{
+  size_t *moved = arg;
+  moved[*index] = 0;
+}
+
+/**
+ * Replaces the position in the given map value with its new index.
+ */
+static void entry_store_renumber(const entry_store_key *key, size_t *index, void *arg)
+{
+  const size_t *moved = arg;
+  *index = moved[*index];
+}
@@ -2,6 +2,9 @@
 #define __ENTRY_H__
 
 #include <stdio.h>
+#include <stdbool.h>
+
+#include "string_util.h"
 
 typedef struct entry
 {
@@ -37,4 +40,142 @@ entry entry_read(FILE *in, int max_id, int battlefields);
  */
 void entry_destroy(entry *e);
 
+/**
+ * Blotto entries kept in two arrays, one of ids and one of
+ * distributions, so that reading n entries takes a few allocations
+ * instead of 2n.  Entry i's id is the string at ENTRY_LIST_ID(list, i)
+ * and its distribution is the battlefields ints at
+ * ENTRY_LIST_DISTRIBUTION(list, i).
+ */
+typedef struct entry_list
+{
+  size_t n;
+  size_t capacity;
+  int max_id;
+  int battlefields;
+  char *ids;
+  int *distributions;
+} entry_list;
+
+#define ENTRY_LIST_ID(list, i) ((list)->ids + (size_t)(i) * ((list)->max_id + 1))
+#define ENTRY_LIST_DISTRIBUTION(list, i) ((list)->distributions + (size_t)(i) * (list)->battlefields)
+
+/**
+ * Reads Blotto entries from the given reader up to the end of input
+ * (a line with an empty id and no more than one field, or EOF) into the
+ * given list.  Each entry is accepted or rejected exactly as by
+ * entry_read.  The distributions are parsed straight into the list's
+ * array, and the input after the end-of-input line is left unread.  It
+ * is the caller's responsibility to destroy the list by passing it to
+ * entry_list_destroy, whether or not reading succeeded.
+ *
+ * @param in a pointer to a reader, non-NULL
+ * @param max_id, a positive integer
+ * @param battlefields a positive integer
+ * @param list a pointer to the list to fill in, non-NULL
+ * @return true if every entry was valid, false if one was not or there
+ * was an allocation error
+ */
+bool entry_read_all(line_reader *in, int max_id, int battlefields, entry_list *list);
+
+/**
+ * Frees the ids and distributions in the given list.
+ *
+ * @param list a pointer to a list, non-NULL
+ */
+void entry_list_destroy(entry_list *list);
+
+// the longest id an entry_store can hold
+#define ENTRY_STORE_MAX_ID 31
+
+// returned by entry_store_find for an id that is not in the store
+#define ENTRY_STORE_MISSING ((size_t)-1)
+
+/**
+ * Blotto entries indexed by id.  Each distinct id is interned once, when
+ * the entries are read, to a dense index from 0 to the number of
+ * distinct ids, and entry i's distribution is row i of one row-major
+ * matrix.  Ids are held by value in the index, so looking one up costs a
+ * hash and a probe of one table with no pointers to follow, and after
+ * that matchups and batch kernels work on indices and contiguous rows.
+ */
+struct _entry_store;
+typedef struct _entry_store entry_store;
+
+/**
+ * Creates an empty store for entries with the given id length and number
+ * of battlefields.
+ *
+ * @param max_id a positive integer, at most ENTRY_STORE_MAX_ID
+ * @param battlefields a positive integer
+ * @return a pointer to the new store, or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the store
+ */
+entry_store *entry_store_create(int max_id, int battlefields);
+
+/**
+ * Reads entries from the given reader into the given empty store, as
+ * entry_read_all does.  Indices follow the order of the input, and an id
+ * given more than once counts only where it was last given.
+ *
+ * @param s a pointer to an empty store, non-NULL
+ * @param in a pointer to a reader, non-NULL
+ * @return true if every entry was valid, false if one was not or there
+ * was an allocation error
+ */
+bool entry_store_read(entry_store *s, line_reader *in);
+
+/**
+ * Returns the number of distinct ids in the given store.
+ *
+ * @param s a pointer to a store, non-NULL
+ * @return the number of entries in s
+ */
+size_t entry_store_size(const entry_store *s);
+
+/**
+ * Returns the index of the given id in the given store.
+ *
+ * @param s a pointer to a store, non-NULL
+ * @param id a pointer to a string, non-NULL
+ * @return the index of id, or ENTRY_STORE_MISSING if it is not present
+ */
+size_t entry_store_find(const entry_store *s, const char *id);
+
+/**
+ * Returns the id with the given index in the given store.
+ *
+ * @param s a pointer to a store, non-NULL
+ * @param index an index less than entry_store_size(s)
+ * @return a pointer to the id, valid until the store is destroyed
+ */
+const char *entry_store_id(const entry_store *s, size_t index);
+
+/**
+ * Returns the distribution matrix of the given store: entry_store_size(s)
+ * rows of battlefields ints, row i for the entry with index i.
+ *
+ * @param s a pointer to a store, non-NULL
+ * @return a pointer to the matrix, valid until the store is destroyed
+ */
+const int *entry_store_matrix(const entry_store *s);
+
+/**
+ * Returns the distribution of the entry with the given index in the given
+ * store.
+ *
+ * @param s a pointer to a store, non-NULL
+ * @param index an index less than entry_store_size(s)
+ * @return a pointer to the entry's row of the matrix
+ */
+const int *entry_store_row(const entry_store *s, size_t index);
+
+/**
+ * Destroys the given store.  There is no effect if the given pointer is
+ * NULL.
+ *
+ * @param s a pointer to a store, or NULL
+ */
+void entry_store_destroy(entry_store *s);
+
 #endif
@@ -7,15 +7,30 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "slab.h"
+
+#ifdef GMAP_STATS
+#include <time.h>
+#endif
 
 char *gmap_error = "error";
 
+// keys of up to this many bytes are stored in their node (gmap_create_bytes only)
+#define GMAP_INLINE_KEY 32
+
 // Nodes to implement chains as singly-linked lists. //
 typedef struct _node
 {
   void* key;
   void* value;
+  // full hash code of key, kept so resizing and lookups can skip the hasher/comparer
+  size_t hash;
   struct _node* next;
+  // GMAP_INLINE_KEY bytes for a short key in maps made by gmap_create_bytes;
+  // key then points here, in the same cache line as the rest of the node
+  char short_key[];
 } node;
 
 // meta struct of the map
@@ -26,35 +41,142 @@ struct _gmap{
     size_t cap;
     // number of key-value pairs in the table
     size_t nkey;
+    // table still being drained by an incremental resize, or NULL
+    node** oldtable;
+    // capacity of oldtable
+    size_t oldcap;
+    // chains of oldtable below this index have been moved to table
+    size_t migrated;
+    // whether embiggen spreads its work over later operations
+    bool incremental;
     // function pointers :
     void* (*copier)(const void *);
     int (*comparer)(const void *, const void *);
     size_t (*hasher)(const void *);
     void (*freer)(void *);
+    // size of a key in bytes for maps made by gmap_create_bytes, else NULL
+    size_t (*sizer)(const void *);
+    // allocator for nodes
+    slab* nodes;
+    // size of a node including its short_key space
+    size_t node_size;
+    // number of key copies too long for short_key, held in the heap
+    size_t nbigkeys;
+    // where each node keeps its count in maps made by gmap_create_counter, else 0
+    size_t count_offset;
+    // Bloom filter of the keys' hash codes in blocks of GMAP_FILTER_WORDS
+    // words, or NULL; it points into filter_mem at a cache line boundary
+    uint64_t* filter;
+    void* filter_mem;
+    size_t filter_blocks;
+    // during an incremental resize, the filter for the new table, filled
+    // as chains are migrated and swapped in once the old table is empty;
+    // NULL otherwise
+    uint64_t* next_filter;
+    void* next_filter_mem;
+    size_t next_filter_blocks;
+#ifdef GMAP_STATS
+    // search and resize counters reported by gmap_get_stats
+    gmap_stats stats;
+#endif
 };
 
 #define SIMAP_INITIAL_CAPACITY 101
 
-// helper function declarations
-node* gmap_find_key(const gmap* m, const char* key);
-void gmap_embiggen(gmap* m);
-/**
- * A location in an array where a key can be stored.  The location is
- * represented by a (array, index) pair.
- */
-typedef struct _gmap_store_location
+// the count kept at the end of node n of a map made by gmap_create_counter
+#define GMAP_NODE_COUNT(m, n) ((int64_t*)((char*)(n) + (m)->count_offset))
+
+// counters for gmap_get_stats; searches take a const map, hence the cast
+#ifdef GMAP_STATS
+#define GMAP_COUNT_SEARCH(m, found, probes) \
+    ((found) ? (((gmap*)(m))->stats.hits++, ((gmap*)(m))->stats.hit_probes += (probes)) \
+             : (((gmap*)(m))->stats.misses++, ((gmap*)(m))->stats.miss_probes += (probes)))
+#define GMAP_TIMER_START(t) clock_t t = clock()
+#define GMAP_TIMER_STOP(m, t) ((m)->stats.resize_seconds += (double)(clock() - (t)) / CLOCKS_PER_SEC)
+#define GMAP_COUNT_RESIZE(m) ((m)->stats.resizes++)
+#else
+#define GMAP_COUNT_SEARCH(m, found, probes) ((void)(probes))
+#define GMAP_TIMER_START(t)
+#define GMAP_TIMER_STOP(m, t) ((void)0)
+#define GMAP_COUNT_RESIZE(m) ((void)0)
+#endif
+
+// number of old chains moved by each put/get/remove during an incremental resize
+#define GMAP_MIGRATE_CHAINS 4
+
+// filter bits per table bucket (so about two bytes), and the words in a
+// filter block, which make one 64-byte cache line; a key sets one bit in
+// each word of its block
+#define GMAP_FILTER_BITS 16
+#define GMAP_FILTER_WORDS 8
+
+// fewest pairs per thread for gmap_build_parallel to start another thread
+#define GMAP_BUILD_MIN_PAIRS 16384
+
+// one thread's share of the work in gmap_build_parallel
+typedef struct _gmap_build_worker
 {
-  const void **arr;
-  size_t index;
-} gmap_store_location;
+    gmap* m;
+    const gmap_pair* pairs;
+    // hash code of each pair
+    size_t* hashes;
+    // indices of the pairs, grouped by part and in order within each part
+    size_t* order;
+    // the table is split into nparts runs of part_buckets buckets
+    size_t nparts;
+    size_t part_buckets;
+    // this thread hashes and sorts pairs [from, to)
+    size_t from;
+    size_t to;
+    // this thread's count of its pairs in each part, then where in order
+    // its next pair in each part goes
+    size_t* counts;
+    // this thread adds the pairs at order[start, end), which all belong in
+    // its own part of the table, with nodes from its own slab
+    size_t start;
+    size_t end;
+    slab* nodes;
+    size_t nkey;
+    size_t nbigkeys;
+    bool ok;
+} gmap_build_worker;
 
-void gmap_store_key_in_array(const void *key, void *value, void *arg)
+// fewest buckets per thread for gmap_for_each_parallel to start another thread
+#define GMAP_FOR_EACH_MIN_BUCKETS 16384
+
+// one thread's share of the buckets in gmap_for_each_parallel
+typedef struct _gmap_for_each_worker
 {
-  gmap_store_location *where = arg;
-  where->arr[where->index] = key;
-  where->index++;
-}
+    gmap* m;
+    void (*f)(const void *, void *, void *);
+    void* arg;
+    size_t from;
+    size_t to;
+} gmap_for_each_worker;
 
+// helper function declarations
+node* gmap_find_key(const gmap* m, const void* key, size_t hash);
+node** gmap_chain(const gmap* m, size_t hash);
+node* gmap_bucket(const gmap* m, size_t bucket);
+node* gmap_find_or_add(gmap* m, const void* key, bool* added);
+void gmap_embiggen(gmap* m);
+bool gmap_resize(gmap* m, size_t newcap);
+void gmap_migrate(gmap* m, size_t nchains);
+void gmap_free_keys(gmap* m, node** table, size_t from, size_t to);
+gmap* gmap_create_common(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *), void (*f)(void *), size_t (*size)(const void *), bool counter);
+bool gmap_copy_key(const gmap* m, node* n, const void* key, size_t* nbigkeys);
+void gmap_run_workers(void* workers, size_t size, size_t nthreads, void* (*phase)(void*));
+void* gmap_build_hash(void* arg);
+void* gmap_build_sort(void* arg);
+void* gmap_build_fill(void* arg);
+void* gmap_for_each_range(void* arg);
+void gmap_free_key(gmap* m, node* n);
+bool gmap_filter_build(gmap* m);
+void* gmap_filter_alloc(size_t cap, uint64_t** filter, size_t* nblocks);
+void gmap_filter_discard_next(gmap* m);
+void gmap_filter_set(uint64_t* filter, size_t nblocks, size_t hash);
+void gmap_filter_add(gmap* m, size_t hash);
+bool gmap_filter_may_contain(const gmap* m, size_t hash);
 // =================================================================================================================
 // Required Function Implementations
 // =================================================================================================================
@@ -77,21 +199,63 @@ gmap *gmap_create(void *(*cp)(const void *), int (*comp)(const void *, const voi
       return NULL;
     }
 
-    // pointer to a new map
-    struct _gmap* newmap = malloc(sizeof(*newmap));
-    if (newmap != NULL) // fill in newmap and return a pointer to it
+    return gmap_create_common(cp, comp, h, f, NULL, false);
+}
+
+
+/**
+ * Creates an empty map whose keys are self-contained blocks of bytes,
+ * such as strings.  The map copies keys itself, and short keys are kept
+ * in the map's own storage instead of being allocated one by one.
+ *
+ * @param size a pointer to a function that takes a pointer to a key and
+ * returns the number of bytes in it (for strings, including the terminator)
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create_bytes(size_t (*size)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *))
+{
+    if (size == NULL || comp == NULL || h == NULL)
     {
-        newmap->table = calloc(SIMAP_INITIAL_CAPACITY, sizeof(node*));
-        newmap->cap = SIMAP_INITIAL_CAPACITY;
-        newmap->nkey = 0;
-        newmap->copier = cp;
-        newmap->comparer = comp;
-        newmap->hasher = h;
-        newmap->freer = f;
+      // one of the required functions was missing
+      return NULL;
     }
 
-    // malloc will return NULL if map creation fails
-    return newmap;
+    return gmap_create_common(NULL, comp, h, NULL, size, false);
+}
+
+
+/**
+ * Creates an empty map from keys to 64-bit counts, for counting keys such
+ * as words.  Keys are copied as for gmap_create_bytes, and each count is
+ * kept in the map's own storage, so counting needs no allocation beyond
+ * the map's.  Counts are changed only by gmap_increment; the value of a
+ * key, as returned by gmap_get, gmap_for_each and the other functions
+ * that report values, is a pointer to its int64_t count, valid until the
+ * key is removed or the map is shrunk or destroyed.  gmap_put,
+ * gmap_get_or_put and gmap_upsert fail on these maps, and gmap_remove
+ * returns NULL.
+ *
+ * @param size a pointer to a function that takes a pointer to a key and
+ * returns the number of bytes in it (for strings, including the terminator)
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create_counter(size_t (*size)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *))
+{
+    if (size == NULL || comp == NULL || h == NULL)
+    {
+      // one of the required functions was missing
+      return NULL;
+    }
+
+    return gmap_create_common(NULL, comp, h, NULL, size, true);
 }
 
 
@@ -126,53 +290,18 @@ void *gmap_put(gmap *m, const void *key, void *value)
 {
     if (m == NULL || key == NULL)
         return NULL;
+    if (m->count_offset != 0)
+        return gmap_error;
 
-    // resize table if load factor == 1
-    if (m->nkey == m->cap)
-        gmap_embiggen(m);
-    
-    // add key-value pair
-    node* thisnode = gmap_find_key(m, key);
-    if(thisnode != NULL)
-    {
-        // key is already present
-        // update value in the key-value pair
-        void* oldvalue = thisnode->value;
-        thisnode->value = value;
-        return oldvalue;
-    }
-    else
-    {
-        // key was not present, must add a new node
-        // copy the key
-        void* keycopy;
-        keycopy = m->copier(key);
-
-        if (keycopy != NULL)
-        {
-            // create a new node
-            node* newnode = malloc(sizeof(node));
-            newnode->key = keycopy;
-            newnode->value = value;
-            newnode->next = NULL;
-            
-            // find place to add
-            size_t index = m->hasher(keycopy) % m->cap;
-
-            // add to the chain's head
-            newnode->next = m->table[index];
-            m->table[index] = newnode;
+    bool added;
+    node* thisnode = gmap_find_or_add(m, key, &added);
+    if(thisnode == NULL)
+        return gmap_error;
 
-            // update counter
-            m->nkey++;
-            return NULL;
-        }
-        else
-        {
-            return NULL;
-        }
-    }
-    
+    // update value in the key-value pair
+    void* oldvalue = added ? NULL : thisnode->value;
+    thisnode->value = value;
+    return oldvalue;
 }
 
 /**
@@ -196,27 +325,33 @@ void *gmap_remove(gmap *m, const void *key)
     node* thisnode=NULL;
     void* result=NULL;
 
-    // find the hash index
-    size_t index = m->hasher(key) % m->cap;
+    gmap_migrate(m, GMAP_MIGRATE_CHAINS);
+
+    // find the chain, unless the filter shows the key is not there
+    size_t hash = m->hasher(key);
+    if (!gmap_filter_may_contain(m, hash))
+        return NULL;
+    node** head = gmap_chain(m, hash);
     
     // traverse through that chain until
     // 1) found the key or 2) end of chain (i.e. curr->next == NULL)
-    curr = m->table[index];
+    curr = *head;
     while(curr != NULL)
     {
-        // check this node's key
-        if(m->comparer(key, curr->key) == 0)
+        // check this node's key (only if the full hash codes agree)
+        if(curr->hash == hash && m->comparer(key, curr->key) == 0)
         {
             thisnode = curr;
             // update prev node's pointer
             if(prev != NULL) prev->next = curr->next;
-            else m->table[index] = curr->next;
+            else *head = curr->next;
 
-            result = thisnode->value;
+            // a counter map's counts go with their nodes
+            result = m->count_offset == 0 ? thisnode->value : NULL;
 
             // free memories associated with node
-            m->freer(thisnode->key);
-            free(thisnode);
+            gmap_free_key(m, thisnode);
+            slab_free(m->nodes, thisnode);
 
             // update counter
             m->nkey--;
@@ -242,7 +377,7 @@ bool gmap_contains_key(const gmap *m, const void *key)
     if(m == NULL || key == NULL)
         return false;
     
-    return gmap_find_key(m, key) != NULL;
+    return gmap_find_key(m, key, m->hasher(key)) != NULL;
 }
 
 
@@ -263,7 +398,8 @@ void *gmap_get(gmap *m, const void *key)
     if (m == NULL || key == NULL)
       return NULL;
 
-    node* thisnode = gmap_find_key(m, key);
+    gmap_migrate(m, GMAP_MIGRATE_CHAINS);
+    node* thisnode = gmap_find_key(m, key, m->hasher(key));
     if(thisnode != NULL)
         return thisnode->value;
     else
@@ -286,7 +422,7 @@ void gmap_for_each(gmap *m, void (*f)(const void *, void *, void *), void *arg)
     if (m == NULL || f == NULL)
       return;
     
-    for(int i = 0; i < m->cap; i++)
+    for(size_t i = 0; i < m->cap; i++)
     {
         node* curr = m->table[i];
         while(curr != NULL)
@@ -295,9 +431,54 @@ void gmap_for_each(gmap *m, void (*f)(const void *, void *, void *), void *arg)
             curr = curr->next;
         }
     }
+    // chains not yet moved by an incremental resize
+    for(size_t i = m->migrated; m->oldtable != NULL && i < m->oldcap; i++)
+    {
+        node* curr = m->oldtable[i];
+        while(curr != NULL)
+        {
+            f(curr->key, curr->value, arg);
+            curr = curr->next;
+        }
+    }
     return;
 }
 
+/**
+ * Calls the given function for each (key, value) pair in this map, as for
+ * gmap_for_each, with the buckets split into ranges visited by up to
+ * nthreads threads.  The thread that visits range t passes args[t].
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param f a pointer to a function that takes a key, a value, and an
+ * extra piece of information, that does not change the map, and that is
+ * safe to call from several threads at once, non-NULL
+ * @param args a pointer to an array of nthreads pointers
+ * @param nthreads the most threads to use, counting the calling thread
+ */
+void gmap_for_each_parallel(gmap *m, void (*f)(const void *, void *, void *), void **args, size_t nthreads)
+{
+    if (m == NULL || f == NULL || args == NULL || nthreads == 0)
+        return;
+
+    size_t buckets = gmap_bucket_count(m);
+    if (nthreads > buckets / GMAP_FOR_EACH_MIN_BUCKETS)
+        nthreads = buckets / GMAP_FOR_EACH_MIN_BUCKETS;
+    if (nthreads <= 1)
+    {
+        gmap_for_each(m, f, args[0]);
+        return;
+    }
+
+    gmap_for_each_worker workers[nthreads];
+    for (size_t t = 0; t < nthreads; t++)
+    {
+        workers[t] = (gmap_for_each_worker){m, f, args[t], buckets * t / nthreads, buckets * (t + 1) / nthreads};
+    }
+    gmap_run_workers(workers, sizeof(gmap_for_each_worker), nthreads, gmap_for_each_range);
+}
+
+
 
 /**
  * Returns an array containing pointers to all of the keys in the
@@ -311,7 +492,7 @@ void gmap_for_each(gmap *m, void (*f)(const void *, void *, void *), void *arg)
  * @param m a pointer to a map, non-NULL
  * @return a pointer to an array of pointers to the keys, or NULL
  */
-// used the optional code gmap_array.c
+// walks the map with a gmap_iter cursor
 const void **gmap_keys(gmap *m)
 {
     if (m == NULL) return NULL;
@@ -320,8 +501,10 @@ const void **gmap_keys(gmap *m)
 
     if (keys != NULL)
     {
-        gmap_store_location loc = {keys, 0};
-        gmap_for_each(m, gmap_store_key_in_array, &loc);
+        gmap_iter it;
+        gmap_iter_begin(m, &it);
+        for(size_t i = 0; gmap_iter_next(&it, keys + i, NULL); i++)
+            ;
     }
     return keys;
 }
@@ -335,22 +518,22 @@ void gmap_destroy(gmap *m)
 {
     if(m != NULL)
     {
-        // free all nodes and their keys
-        for(int i = 0; i < m->cap; i++)
+        // keys only need visiting if some are not inside the nodes
+        if(m->sizer == NULL || m->nbigkeys > 0)
         {
-            node* curr = m->table[i];
-            node* aux;
-            while(curr != NULL)
-            {
-                aux = curr;
-                if(curr->key != NULL) m->freer(curr->key); // free key of the node
-                // if(curr->value != NULL) m->freer(curr->value); // free value of the node
-                curr = curr->next;
-                free(aux); // free node
-            }
+            gmap_free_keys(m, m->table, 0, m->cap);
+            if(m->oldtable != NULL)
+                gmap_free_keys(m, m->oldtable, m->migrated, m->oldcap);
         }
-        // free the table
+
+        // free all nodes and the short keys in them a block at a time
+        slab_destroy(m->nodes);
+
+        // free the tables
         free(m->table);
+        free(m->oldtable);
+        free(m->filter_mem);
+        free(m->next_filter_mem);
 
         // free the gmap struct
         free(m);
@@ -359,76 +542,1022 @@ void gmap_destroy(gmap *m)
     return;
 }
 
+/**
+ * Chooses whether this map resizes all at once or incrementally.  In
+ * incremental mode the old and new tables coexist after a resize and each
+ * later put, get, and remove moves a bounded amount of old entries, so no
+ * single operation pays for rehashing the whole map.  Turning the mode off
+ * finishes any resize in progress.  Backends that cannot resize
+ * incrementally always resize all at once and say so by returning false
+ * when asked for incremental mode.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param incremental true for incremental resizing, false for all at once
+ * @return true if the map now resizes as asked, false otherwise
+ */
+bool gmap_set_incremental_resize(gmap *m, bool incremental)
+{
+    if (m == NULL)
+        return false;
+
+    m->incremental = incremental;
+    if (!incremental)
+        gmap_migrate(m, m->oldcap);
+    return true;
+}
+
+/**
+ * Chooses whether this map keeps a Bloom filter of its keys' hash codes.
+ * With the filter, most searches for keys that are not present (by get,
+ * contains_key, lookup and remove) are answered from one cache line of
+ * the filter without walking a chain or calling the compare function.
+ * The filter takes about two bytes per bucket; it is updated by every put
+ * and rebuilt whenever the table is resized.  Removed keys stay in the
+ * filter until the next rebuild, so removals leave it less selective but
+ * never wrong.  Searches for keys that are present read the filter too,
+ * so it pays off when many searches miss.  Backends whose misses are
+ * already cheap ignore this setting.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param enabled true to keep a filter, false to discard it
+ * @return true if successful, false if the filter could not be allocated
+ */
+bool gmap_set_miss_filter(gmap *m, bool enabled)
+{
+    if (m == NULL)
+        return false;
+
+    if (enabled)
+        return m->filter != NULL || gmap_filter_build(m);
+
+    gmap_filter_discard_next(m);
+    free(m->filter_mem);
+    m->filter = NULL;
+    m->filter_mem = NULL;
+    m->filter_blocks = 0;
+    return true;
+}
+
+/**
+ * Makes room for at least n pairs in this map, so that putting them does
+ * not resize it again.  Any incremental resize in progress is finished
+ * first.  The map is unchanged if the larger table cannot be allocated.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param n the number of pairs to make room for
+ * @return true if successful, false if there was an allocation error
+ */
+bool gmap_reserve(gmap *m, size_t n)
+{
+    if (m == NULL)
+        return false;
+
+    // puts embiggen only when adding to a map with nkey == cap
+    gmap_migrate(m, m->oldcap);
+    if (n <= m->cap)
+        return true;
+
+    bool ok = gmap_resize(m, n | 1);
+    gmap_migrate(m, m->oldcap);
+    return ok;
+}
+
+/**
+ * Shrinks this map's table to the smallest capacity that holds its
+ * current pairs (but not below the initial capacity) and moves its
+ * entries into freshly allocated memory so that space left behind by
+ * removals is returned.  Pointers to keys obtained from the map become
+ * invalid for maps made by gmap_create_bytes.  The map is unchanged if
+ * the new memory cannot be allocated.
+ *
+ * @param m a pointer to a map, non-NULL
+ */
+void gmap_shrink_to_fit(gmap *m)
+{
+    if (m == NULL)
+        return;
+
+    gmap_migrate(m, m->oldcap);
+    size_t newcap = m->nkey < SIMAP_INITIAL_CAPACITY ? SIMAP_INITIAL_CAPACITY : m->nkey | 1;
+
+    // slabs never give blocks back while in use, so copy into a new one
+    node** newtable = calloc(newcap, sizeof(node*));
+    slab* newnodes = slab_create(m->node_size);
+    bool ok = newtable != NULL && newnodes != NULL;
+
+    for (size_t i = 0; ok && i < m->cap; i++)
+    {
+        for (node* curr = m->table[i]; ok && curr != NULL; curr = curr->next)
+        {
+            node* copy = slab_alloc(newnodes);
+            ok = copy != NULL;
+            if (ok)
+            {
+                // short keys move with their node; long keys stay put
+                memcpy(copy, curr, m->node_size);
+                if (curr->key == curr->short_key)
+                    copy->key = copy->short_key;
+                if (m->count_offset != 0)
+                    copy->value = GMAP_NODE_COUNT(m, copy);
+
+                size_t index = curr->hash % newcap;
+                copy->next = newtable[index];
+                newtable[index] = copy;
+            }
+        }
+    }
+
+    slab_destroy(ok ? m->nodes : newnodes);
+    if (!ok)
+    {
+        free(newtable);
+        return;
+    }
+
+    free(m->table);
+    m->table = newtable;
+    m->cap = newcap;
+    m->nodes = newnodes;
+
+    // drop the bits of removed keys too; the old filter stays if this fails
+    if (m->filter != NULL)
+        gmap_filter_build(m);
+}
+
+/**
+ * Adds copies of the given keys with their values to this empty map,
+ * spreading the work over up to nthreads threads.  The result is the same
+ * as putting the pairs one at a time in order, so a later pair replaces
+ * the value of an earlier one with an equal key.  The map's hash, compare
+ * and copy functions are called from several threads at once and must be
+ * safe to call that way.  Backends that cannot build in parallel, and
+ * inputs too small to be worth the threads, put the pairs one at a time.
+ *
+ * @param m a pointer to an empty map, non-NULL
+ * @param pairs a pointer to an array of n pairs with non-NULL keys
+ * @param n the number of pairs
+ * @param nthreads the most threads to use, counting the calling thread
+ * @return true if successful, false if m was not empty or there was an
+ * allocation error, in which case m holds some of the pairs
+ */
+bool gmap_build_parallel(gmap *m, const gmap_pair *pairs, size_t n, size_t nthreads)
+{
+    if (m == NULL || m->nkey != 0 || m->count_offset != 0 || !gmap_reserve(m, n))
+        return false;
+
+    if (nthreads > n / GMAP_BUILD_MIN_PAIRS)
+        nthreads = n / GMAP_BUILD_MIN_PAIRS;
+    if (nthreads < 2)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (gmap_put(m, pairs[i].key, pairs[i].value) == gmap_error)
+                return false;
+        }
+        return true;
+    }
+
+    // each thread later owns one part: a run of buckets and the pairs in it
+    size_t nparts = nthreads;
+    size_t* hashes = malloc(n * sizeof(size_t));
+    size_t* order = malloc(n * sizeof(size_t));
+    size_t* counts = calloc(nthreads * nparts, sizeof(size_t));
+    gmap_build_worker* workers = calloc(nthreads, sizeof(gmap_build_worker));
+    bool ok = hashes != NULL && order != NULL && counts != NULL && workers != NULL;
+
+    for (size_t t = 0; ok && t < nthreads; t++)
+    {
+        gmap_build_worker* w = &workers[t];
+        w->m = m;
+        w->pairs = pairs;
+        w->hashes = hashes;
+        w->order = order;
+        w->nparts = nparts;
+        w->part_buckets = (m->cap + nparts - 1) / nparts;
+        w->from = n / nthreads * t;
+        w->to = t == nthreads - 1 ? n : n / nthreads * (t + 1);
+        w->counts = counts + t * nparts;
+        w->nodes = slab_create(m->node_size);
+        w->ok = true;
+        ok = w->nodes != NULL;
+    }
+
+    if (ok)
+    {
+        gmap_run_workers(workers, sizeof(gmap_build_worker), nthreads, gmap_build_hash);
+
+        // lay the parts out in order, each thread's pairs in a part after
+        // those of the threads before it, so every part keeps input order
+        size_t next = 0;
+        for (size_t p = 0; p < nparts; p++)
+        {
+            workers[p].start = next;
+            for (size_t t = 0; t < nthreads; t++)
+            {
+                size_t count = workers[t].counts[p];
+                workers[t].counts[p] = next;
+                next += count;
+            }
+            workers[p].end = next;
+        }
+
+        gmap_run_workers(workers, sizeof(gmap_build_worker), nthreads, gmap_build_sort);
+        gmap_run_workers(workers, sizeof(gmap_build_worker), nthreads, gmap_build_fill);
+    }
+
+    for (size_t t = 0; workers != NULL && t < nthreads; t++)
+    {
+        // a part left unfinished by an allocation error is still consistent
+        ok = ok && workers[t].ok;
+        m->nkey += workers[t].nkey;
+        m->nbigkeys += workers[t].nbigkeys;
+        slab_merge(m->nodes, workers[t].nodes);
+    }
+
+    free(hashes);
+    free(order);
+    free(counts);
+    free(workers);
+
+    // the threads did not add to the filter
+    if (m->filter != NULL && !gmap_filter_build(m))
+        gmap_set_miss_filter(m, false);
+    return ok;
+}
+
+/**
+ * Fills in the given statistics for the given map.  This visits every
+ * entry, so it takes time proportional to the size of the map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param stats a pointer to the statistics to fill in, non-NULL
+ */
+void gmap_get_stats(const gmap *m, gmap_stats *stats)
+{
+    if (m == NULL || stats == NULL)
+        return;
+
+#ifdef GMAP_STATS
+    *stats = m->stats;
+#else
+    *stats = (gmap_stats){0};
+#endif
+    stats->size = m->nkey;
+    stats->buckets = m->cap;
+    stats->load_factor = (double)m->nkey / m->cap;
+
+    for (size_t b = 0; b < gmap_bucket_count(m); b++)
+    {
+        // old chains that were already moved are not part of the map
+        if (b >= m->cap && b - m->cap < m->migrated)
+            continue;
+
+        size_t len = 0;
+        for (node* curr = gmap_bucket(m, b); curr != NULL; curr = curr->next)
+        {
+            len++;
+            if (m->sizer != NULL && curr->key != curr->short_key)
+                stats->key_bytes += m->sizer(curr->key);
+        }
+        stats->histogram[len < GMAP_STATS_HISTOGRAM ? len : GMAP_STATS_HISTOGRAM - 1]++;
+        if (len > stats->longest)
+            stats->longest = len;
+    }
+
+    stats->table_bytes = (m->cap + (m->oldtable != NULL ? m->oldcap : 0)) * sizeof(node*)
+        + (m->filter_blocks + m->next_filter_blocks) * GMAP_FILTER_WORDS * sizeof(uint64_t);
+    stats->node_bytes = slab_bytes(m->nodes);
+}
+
+/**
+ * Returns the value associated with the given key, first adding a copy
+ * of the key with the given value if it is not present.  The key is
+ * hashed once and its chain is searched once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param value a pointer to the value to add if key is not present
+ * @return the existing value, or value if it was added, or a pointer to gmap_error
+ */
+void *gmap_get_or_put(gmap *m, const void *key, void *value)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+    if (m->count_offset != 0)
+        return gmap_error;
+
+    bool added;
+    node* thisnode = gmap_find_or_add(m, key, &added);
+    if(thisnode == NULL)
+        return gmap_error;
+
+    if(added)
+        thisnode->value = value;
+    return thisnode->value;
+}
+
+
+/**
+ * Replaces the value associated with the given key by the result of
+ * calling update on the current value, adding a copy of the key first
+ * if it is not present.  The key is hashed once and its chain is
+ * searched once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param update a pointer to a function that takes the current value (NULL
+ * if the key was not present), whether the key was present, and the extra
+ * argument, and returns the new value, non-NULL
+ * @param arg a pointer passed to update
+ * @return the new value, or a pointer to gmap_error
+ */
+void *gmap_upsert(gmap *m, const void *key, void *(*update)(void *, bool, void *), void *arg)
+{
+    if (m == NULL || key == NULL || update == NULL)
+        return NULL;
+    if (m->count_offset != 0)
+        return gmap_error;
+
+    bool added;
+    node* thisnode = gmap_find_or_add(m, key, &added);
+    if(thisnode == NULL)
+        return gmap_error;
+
+    thisnode->value = update(thisnode->value, !added, arg);
+    return thisnode->value;
+}
+
+
+/**
+ * Adds delta to the count of the given key in a map made by
+ * gmap_create_counter, first adding a copy of the key with a count of 0
+ * if it is not present.  The key is hashed once and its position in the
+ * table is found once.
+ *
+ * @param m a pointer to a map made by gmap_create_counter, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param delta the amount to add
+ * @return a pointer to the key's new count, or NULL if there was an
+ * allocation error or m is not a counting map
+ */
+int64_t *gmap_increment(gmap *m, const void *key, int64_t delta)
+{
+    if (m == NULL || key == NULL || m->count_offset == 0)
+        return NULL;
+
+    // new nodes start with a count of 0
+    bool added;
+    node* thisnode = gmap_find_or_add(m, key, &added);
+    if(thisnode == NULL)
+        return NULL;
+
+    int64_t* count = thisnode->value;
+    *count += delta;
+    return count;
+}
+
+
+/**
+ * Returns a handle to the value associated with the given key, or NULL if
+ * the key is not present.  The value can be read and replaced through the
+ * handle without another lookup.  The handle is valid until the next put,
+ * remove, or other change to the map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the stored value pointer, or NULL
+ */
+void **gmap_lookup(gmap *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    gmap_migrate(m, GMAP_MIGRATE_CHAINS);
+    node* thisnode = gmap_find_key(m, key, m->hasher(key));
+    return thisnode == NULL ? NULL : &thisnode->value;
+}
+
+/**
+ * Returns the number of buckets in the given map.  Buckets are numbered
+ * from 0, and gmap_iter_range can visit any contiguous range of them.
+ * During an incremental resize the old table's chains are numbered after
+ * the new table's.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @return the number of buckets in the map
+ */
+size_t gmap_bucket_count(const gmap *m)
+{
+    if (m == NULL)
+        return 0;
+    return m->cap + (m->oldtable != NULL ? m->oldcap : 0);
+}
+
+
+/**
+ * Starts a cursor over every (key, value) pair in the given map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param it a pointer to a cursor to initialize, non-NULL
+ */
+void gmap_iter_begin(gmap *m, gmap_iter *it)
+{
+    gmap_iter_range(m, it, 0, gmap_bucket_count(m));
+}
+
+
+/**
+ * Starts a cursor over the (key, value) pairs in buckets from (inclusive)
+ * to to (exclusive) of the given map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param it a pointer to a cursor to initialize, non-NULL
+ * @param from the first bucket to visit
+ * @param to one past the last bucket to visit, at most gmap_bucket_count(m)
+ */
+void gmap_iter_range(gmap *m, gmap_iter *it, size_t from, size_t to)
+{
+    it->m = m;
+    it->bucket = from;
+    it->end = to;
+    it->pos = NULL; // next node to return in the current chain
+}
+
+
+/**
+ * Advances the given cursor, storing the next key and value through key
+ * and value if they are non-NULL.
+ *
+ * @param it a pointer to a cursor started by gmap_iter_begin or gmap_iter_range
+ * @param key a pointer to where to store a pointer to the key, or NULL
+ * @param value a pointer to where to store the value pointer, or NULL
+ * @return true if a pair was found, false if the cursor is finished
+ */
+bool gmap_iter_next(gmap_iter *it, const void **key, void **value)
+{
+    node* curr = it->pos;
+    while(curr == NULL)
+    {
+        if(it->m == NULL || it->bucket >= it->end)
+            return false;
+        curr = gmap_bucket(it->m, it->bucket);
+        it->bucket++;
+    }
+
+    if(key != NULL) *key = curr->key;
+    if(value != NULL) *value = curr->value;
+    it->pos = curr->next;
+    return true;
+}
+
 // =================================================================================================================
 // Helper Function Implementations
 // =================================================================================================================
 
 /**
  * Returns the node in the given chained hash table containing the given
- * key, or NULL if there is no such node.
+ * key, or NULL if there is no such node.  hash must be m->hasher(key).
  */
-node* gmap_find_key(const gmap* m, const char* key)
+node* gmap_find_key(const gmap* m, const void* key, size_t hash)
 {
     // we already account for this case in implementing functions, but just in case:
     if(m == NULL || key == NULL)
         return NULL;
         
     node* result = NULL;
+    if (!gmap_filter_may_contain(m, hash))
+    {
+        GMAP_COUNT_SEARCH(m, false, 0);
+        return NULL;
+    }
     
-    // find the hash index
-    size_t index = m->hasher(key) % m->cap;
-    
-    // traverse through that chain until
+    // traverse through the key's chain until
     // 1) found the key or 2) end of chain (i.e. curr->next == NULL)
-    node* curr = m->table[index];
+    node* curr = *gmap_chain(m, hash);
+    size_t probes = 0;
     
     while(curr != NULL)
     {
-        // check this node's key
-        if(m->comparer(key, curr->key) == 0)
+        probes++;
+        // check this node's key (only if the full hash codes agree)
+        if(curr->hash == hash && m->comparer(key, curr->key) == 0)
         {
             result = curr;
             break;
         }
         curr = curr->next;
     }
+    GMAP_COUNT_SEARCH(m, result != NULL, probes);
     return result;
 }
 
+/**
+ * Returns a pointer to the head of the chain where a key with the given
+ * hash is (or would be) stored.  During an incremental resize that is in
+ * the old table until the key's old chain has been migrated.
+ */
+node** gmap_chain(const gmap* m, size_t hash)
+{
+    if(m->oldtable != NULL)
+    {
+        size_t oldindex = hash % m->oldcap;
+        if(oldindex >= m->migrated)
+            return &m->oldtable[oldindex];
+    }
+    return &m->table[hash % m->cap];
+}
+
+/**
+ * Returns the node for key, adding a node with a copy of the key and a
+ * NULL value if it is not present, or NULL if there was an allocation
+ * error.  Sets *added to whether a node was added.
+ */
+node* gmap_find_or_add(gmap* m, const void* key, bool* added)
+{
+    // resize table if load factor == 1
+    gmap_migrate(m, GMAP_MIGRATE_CHAINS);
+    if (m->nkey == m->cap)
+        gmap_embiggen(m);
+
+    // traverse the key's chain, remembering where it starts
+    size_t hash = m->hasher(key);
+    node** head = gmap_chain(m, hash);
+    size_t probes = 0;
+    for(node* curr = *head; curr != NULL; curr = curr->next)
+    {
+        probes++;
+        if(curr->hash == hash && m->comparer(key, curr->key) == 0)
+        {
+            GMAP_COUNT_SEARCH(m, true, probes);
+            *added = false;
+            return curr;
+        }
+    }
+    GMAP_COUNT_SEARCH(m, false, probes);
+
+    // key was not present, must add a new node
+    node* newnode = slab_alloc(m->nodes);
+    if (newnode == NULL)
+        return NULL;
+    if (!gmap_copy_key(m, newnode, key, &m->nbigkeys))
+    {
+        slab_free(m->nodes, newnode);
+        return NULL;
+    }
+    newnode->value = NULL;
+    if (m->count_offset != 0)
+    {
+        newnode->value = GMAP_NODE_COUNT(m, newnode);
+        *GMAP_NODE_COUNT(m, newnode) = 0;
+    }
+    newnode->hash = hash;
+    gmap_filter_add(m, hash);
+
+    // add to the head of the chain where the key belongs
+    newnode->next = *head;
+    *head = newnode;
+
+    // update counter
+    m->nkey++;
+    *added = true;
+    return newnode;
+}
+
+/**
+ * Returns the head of the chain with the given bucket number, counting the
+ * new table's chains first and then the old table's during a resize.
+ */
+node* gmap_bucket(const gmap* m, size_t bucket)
+{
+    if(bucket < m->cap)
+        return m->table[bucket];
+
+    // chains below migrated have been emptied into the new table
+    bucket -= m->cap;
+    return bucket < m->oldcap ? m->oldtable[bucket] : NULL;
+}
+
 /*
- * Resize gmap's table (to ~double the previous size)
+ * Resize gmap's table (to ~double the previous size).  In incremental
+ * mode the old table is kept and drained by later operations; otherwise
+ * every chain is moved now.
  */
 void gmap_embiggen(gmap* m)
 {
-    size_t oldcap = m->cap;
-    // increase table size
-    m->cap = (m->cap)*2 + 1; // not a prime, but good enough
-    node** oldtable = m->table;
-    m->table = calloc(m->cap, sizeof(node*));
-    if(m->table == NULL) return;
-    
+    gmap_resize(m, (m->cap)*2 + 1); // not a prime, but good enough
+    return;
+}
+
+/*
+ * Start moving the map into a table with newcap chains, finishing the move
+ * now unless the map is incremental.  Returns false if the new table could
+ * not be allocated, leaving the map as it was.
+ */
+bool gmap_resize(gmap* m, size_t newcap)
+{
+    // a previous resize must be finished before starting another
+    gmap_migrate(m, m->oldcap);
+
+    node** newtable = calloc(newcap, sizeof(node*));
+    if(newtable == NULL) return false;
+
+    m->oldtable = m->table;
+    m->oldcap = m->cap;
+    m->migrated = 0;
+    m->table = newtable;
+    m->cap = newcap;
+    GMAP_COUNT_RESIZE(m);
+
+    // size the filter for the new table; the old one is still correct if
+    // a bigger one cannot be allocated, just less selective.  Rebuilding
+    // would visit every key, so an incremental resize instead fills the
+    // new filter as it migrates chains and keeps using the old one until
+    // then
+    if(m->filter != NULL && !m->incremental)
+        gmap_filter_build(m);
+    else if(m->filter != NULL)
+        m->next_filter_mem = gmap_filter_alloc(m->cap, &m->next_filter, &m->next_filter_blocks);
+
+    if(!m->incremental)
+        gmap_migrate(m, m->oldcap);
+    return true;
+}
+
+/*
+ * Move up to nchains chains from the old table into the new one, using the
+ * saved hashes.  Frees the old table once it is empty.
+ */
+void gmap_migrate(gmap* m, size_t nchains)
+{
     node* save=NULL;
     node* curr=NULL;
 
-    // go through the table
-    for(int i = 0; i < oldcap; i++)
+    if(m->oldtable == NULL)
+        return;
+    GMAP_TIMER_START(start);
+
+    while(m->oldtable != NULL && nchains > 0)
     {
         // go through the chain
-        curr = oldtable[i];
+        curr = m->oldtable[m->migrated];
         while(curr != NULL)
         {
             save = curr->next;
-            
-            // put node('s pointer)s into new table
-            size_t index = m->hasher(curr->key) % m->cap;
-            
+
             // put into head of the chain and adjust next pointers
+            size_t index = curr->hash % m->cap;
             curr->next = m->table[index];
             m->table[index] = curr;
+            if(m->next_filter != NULL)
+                gmap_filter_set(m->next_filter, m->next_filter_blocks, curr->hash);
             curr = save;
         }
-    }
+        m->oldtable[m->migrated] = NULL;
+        m->migrated++;
+        nchains--;
 
-    free(oldtable);
+        if(m->migrated == m->oldcap)
+        {
+            free(m->oldtable);
+            m->oldtable = NULL;
+            m->oldcap = 0;
+            m->migrated = 0;
+
+            // every key is now in the new filter
+            if(m->next_filter != NULL)
+            {
+                free(m->filter_mem);
+                m->filter = m->next_filter;
+                m->filter_mem = m->next_filter_mem;
+                m->filter_blocks = m->next_filter_blocks;
+                m->next_filter = NULL;
+                m->next_filter_mem = NULL;
+                m->next_filter_blocks = 0;
+            }
+        }
+    }
+    GMAP_TIMER_STOP(m, start);
     return;
-}
\ No newline at end of file
+}
+
+/*
+ * Free the keys in chains [from, to) of the given table.  The nodes
+ * themselves are released with the node slab.
+ */
+void gmap_free_keys(gmap* m, node** table, size_t from, size_t to)
+{
+    for(size_t i = from; i < to; i++)
+    {
+        node* curr = table[i];
+        while(curr != NULL)
+        {
+            if(curr->key != NULL) gmap_free_key(m, curr); // free key of the node
+            curr = curr->next;
+        }
+    }
+}
+
+/*
+ * Call phase on each of nthreads workers of the given size, each in a
+ * thread of its own.  A worker whose thread cannot be started runs in the
+ * calling thread instead.
+ */
+void gmap_run_workers(void* workers, size_t size, size_t nthreads, void* (*phase)(void*))
+{
+    char* w = workers;
+    pthread_t threads[nthreads];
+    bool started[nthreads];
+    for (size_t t = 1; t < nthreads; t++)
+        started[t] = pthread_create(&threads[t], NULL, phase, w + t * size) == 0;
+
+    phase(w);
+    for (size_t t = 1; t < nthreads; t++)
+    {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            phase(w + t * size);
+    }
+}
+
+/*
+ * Hash the worker's pairs and count how many fall in each part.
+ */
+void* gmap_build_hash(void* arg)
+{
+    gmap_build_worker* w = arg;
+    for (size_t i = w->from; i < w->to; i++)
+    {
+        w->hashes[i] = w->m->hasher(w->pairs[i].key);
+        w->counts[w->hashes[i] % w->m->cap / w->part_buckets]++;
+    }
+    return NULL;
+}
+
+/*
+ * Put the indices of the worker's pairs in their parts' places in order.
+ */
+void* gmap_build_sort(void* arg)
+{
+    gmap_build_worker* w = arg;
+    for (size_t i = w->from; i < w->to; i++)
+        w->order[w->counts[w->hashes[i] % w->m->cap / w->part_buckets]++] = i;
+    return NULL;
+}
+
+/*
+ * Add the pairs in the worker's part to the table.  No other thread
+ * touches the part's chains, so no locks are needed.
+ */
+void* gmap_build_fill(void* arg)
+{
+    gmap_build_worker* w = arg;
+    gmap* m = w->m;
+    for (size_t k = w->start; k < w->end; k++)
+    {
+        const gmap_pair* pair = &w->pairs[w->order[k]];
+        size_t hash = w->hashes[w->order[k]];
+        node** head = &m->table[hash % m->cap];
+
+        // a later pair with an equal key replaces the value
+        node* curr = *head;
+        while (curr != NULL && (curr->hash != hash || m->comparer(pair->key, curr->key) != 0))
+            curr = curr->next;
+        if (curr == NULL)
+        {
+            curr = slab_alloc(w->nodes);
+            if (curr == NULL || !gmap_copy_key(m, curr, pair->key, &w->nbigkeys))
+            {
+                slab_free(w->nodes, curr);
+                w->ok = false;
+                return NULL;
+            }
+            curr->hash = hash;
+            curr->next = *head;
+            *head = curr;
+            w->nkey++;
+        }
+        curr->value = pair->value;
+    }
+    return NULL;
+}
+
+/*
+ * Call the worker's function on each pair in its range of buckets.
+ */
+void* gmap_for_each_range(void* arg)
+{
+    gmap_for_each_worker* w = arg;
+    gmap_iter it;
+    const void* key;
+    void* value;
+    gmap_iter_range(w->m, &it, w->from, w->to);
+    while (gmap_iter_next(&it, &key, &value))
+        w->f(key, value, w->arg);
+    return NULL;
+}
+
+/*
+ * Create a map with the given key functions.  Exactly one of cp (with f)
+ * or size is non-NULL; a counting map has size.
+ */
+gmap* gmap_create_common(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *), void (*f)(void *), size_t (*size)(const void *), bool counter)
+{
+    // pointer to a new map
+    struct _gmap* newmap = calloc(1, sizeof(*newmap));
+    if (newmap == NULL)
+        return NULL;
+
+    // fill in newmap and return a pointer to it
+    newmap->table = calloc(SIMAP_INITIAL_CAPACITY, sizeof(node*));
+    newmap->cap = SIMAP_INITIAL_CAPACITY;
+    newmap->nkey = 0;
+    newmap->oldtable = NULL;
+    newmap->incremental = false;
+    newmap->copier = cp;
+    newmap->comparer = comp;
+    newmap->hasher = h;
+    newmap->freer = f;
+    newmap->sizer = size;
+    newmap->node_size = sizeof(node) + (size != NULL ? GMAP_INLINE_KEY : 0);
+    if (counter)
+    {
+        // the count goes after the short key space, which keeps it aligned
+        newmap->count_offset = newmap->node_size;
+        newmap->node_size += sizeof(int64_t);
+    }
+    newmap->nodes = slab_create(newmap->node_size);
+
+    if (newmap->table == NULL || newmap->nodes == NULL)
+    {
+        free(newmap->table);
+        slab_destroy(newmap->nodes);
+        free(newmap);
+        return NULL;
+    }
+    return newmap;
+}
+
+/*
+ * Make the map's own copy of key for node n, in n itself if it is short
+ * enough, counting a copy made in the heap in *nbigkeys.  Returns false on
+ * allocation failure.
+ */
+bool gmap_copy_key(const gmap* m, node* n, const void* key, size_t* nbigkeys)
+{
+    if (m->sizer == NULL)
+    {
+        n->key = m->copier(key);
+        return n->key != NULL;
+    }
+
+    size_t size = m->sizer(key);
+    n->key = size <= GMAP_INLINE_KEY ? n->short_key : malloc(size);
+    if (n->key == NULL)
+        return false;
+    memcpy(n->key, key, size);
+    if (n->key != n->short_key) (*nbigkeys)++;
+    return true;
+}
+
+/*
+ * Release the key copy made by gmap_copy_key for node n
+ */
+void gmap_free_key(gmap* m, node* n)
+{
+    if (m->sizer == NULL)
+        m->freer(n->key);
+    else if (n->key != n->short_key)
+    {
+        free(n->key);
+        m->nbigkeys--;
+    }
+}
+
+/*
+ * Replace the map's filter with one sized for its table and holding every
+ * key in it, in both tables during an incremental resize.  Returns false,
+ * leaving the map as it was, if the new filter could not be allocated.
+ */
+bool gmap_filter_build(gmap* m)
+{
+    uint64_t* filter;
+    size_t nblocks;
+    void* mem = gmap_filter_alloc(m->cap, &filter, &nblocks);
+    if (mem == NULL)
+        return false;
+
+    // this one holds every key, so a filter still being filled is not needed
+    gmap_filter_discard_next(m);
+    free(m->filter_mem);
+    m->filter_mem = mem;
+    m->filter = filter;
+    m->filter_blocks = nblocks;
+
+    for (size_t b = 0; b < gmap_bucket_count(m); b++)
+    {
+        // old chains that were already moved are not part of the map
+        if (b >= m->cap && b - m->cap < m->migrated)
+            continue;
+        for (node* curr = gmap_bucket(m, b); curr != NULL; curr = curr->next)
+            gmap_filter_add(m, curr->hash);
+    }
+    return true;
+}
+
+/*
+ * Returns the block of the filter for the given hash code, and stores in
+ * bits the code's bit in each word of that block.  The code is mixed
+ * first (the murmur3 finalizer) since the map's hash functions may not
+ * spread their bits.
+ */
+static inline uint64_t* gmap_filter_block(const uint64_t* filter, size_t nblocks, size_t hash, uint64_t bits[GMAP_FILTER_WORDS])
+{
+    // odd multipliers, each picking a different six bits out of the code
+    static const uint32_t salts[GMAP_FILTER_WORDS] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+
+    uint64_t x = hash;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    uint32_t high = (uint32_t)(x >> 32);
+    for (int i = 0; i < GMAP_FILTER_WORDS; i++)
+        bits[i] = (uint64_t)1 << ((uint32_t)(high * salts[i]) >> 26);
+    return (uint64_t*)filter + (uint32_t)x % nblocks * GMAP_FILTER_WORDS;
+}
+
+/*
+ * Allocate an empty filter sized for a table with cap chains, storing its
+ * first block in filter and its number of blocks in nblocks.  Returns the
+ * memory to free, or NULL if it could not be allocated.
+ */
+void* gmap_filter_alloc(size_t cap, uint64_t** filter, size_t* nblocks)
+{
+    size_t line = GMAP_FILTER_WORDS * sizeof(uint64_t);
+    *nblocks = cap * GMAP_FILTER_BITS / (line * 8) + 1;
+
+    // one extra block's space so the blocks can start on a line boundary
+    void* mem = calloc(*nblocks + 1, line);
+    *filter = mem == NULL ? NULL : (uint64_t*)(((uintptr_t)mem + line - 1) / line * line);
+    if (mem == NULL)
+        *nblocks = 0;
+    return mem;
+}
+
+/*
+ * Drop the filter being filled by an incremental resize, if there is one
+ */
+void gmap_filter_discard_next(gmap* m)
+{
+    free(m->next_filter_mem);
+    m->next_filter = NULL;
+    m->next_filter_mem = NULL;
+    m->next_filter_blocks = 0;
+}
+
+/*
+ * Record the given hash code in the given filter of nblocks blocks
+ */
+void gmap_filter_set(uint64_t* filter, size_t nblocks, size_t hash)
+{
+    uint64_t bits[GMAP_FILTER_WORDS];
+    uint64_t* block = gmap_filter_block(filter, nblocks, hash, bits);
+    for (int i = 0; i < GMAP_FILTER_WORDS; i++)
+        block[i] |= bits[i];
+}
+
+/*
+ * Record the given hash code in the map's filter, if it has one, and in
+ * the filter an incremental resize is filling
+ */
+void gmap_filter_add(gmap* m, size_t hash)
+{
+    if (m->filter != NULL)
+        gmap_filter_set(m->filter, m->filter_blocks, hash);
+    if (m->next_filter != NULL)
+        gmap_filter_set(m->next_filter, m->next_filter_blocks, hash);
+}
+
+/*
+ * Returns false if no key with the given hash code has been put in the
+ * map since its filter was built, true if one may have been or there is
+ * no filter.
+ */
+bool gmap_filter_may_contain(const gmap* m, size_t hash)
+{
+    if (m->filter == NULL)
+        return true;
+
+    uint64_t bits[GMAP_FILTER_WORDS];
+    const uint64_t* block = gmap_filter_block(m->filter, m->filter_blocks, hash, bits);
+    uint64_t missing = 0;
+    for (int i = 0; i < GMAP_FILTER_WORDS; i++)
+        missing |= bits[i] & ~block[i];
+    return missing == 0;
+}
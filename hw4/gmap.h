@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 struct _gmap;
 typedef struct _gmap gmap;
@@ -26,6 +27,44 @@ extern char *gmap_error;
 gmap *gmap_create(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *s), void (*f)(void *));
 
 
+/**
+ * Creates an empty map whose keys are self-contained blocks of bytes,
+ * such as strings.  The map copies keys itself, and short keys are kept
+ * in the map's own storage instead of being allocated one by one.
+ *
+ * @param size a pointer to a function that takes a pointer to a key and
+ * returns the number of bytes in it (for strings, including the terminator)
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create_bytes(size_t (*size)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *));
+
+
+/**
+ * Creates an empty map from keys to 64-bit counts, for counting keys such
+ * as words.  Keys are copied as for gmap_create_bytes, and each count is
+ * kept in the map's own storage, so counting needs no allocation beyond
+ * the map's.  Counts are changed only by gmap_increment; the value of a
+ * key, as returned by gmap_get, gmap_for_each and the other functions
+ * that report values, is a pointer to its int64_t count, valid until the
+ * key is removed or the map is shrunk or destroyed.  gmap_put,
+ * gmap_get_or_put and gmap_upsert fail on these maps, and gmap_remove
+ * returns NULL.
+ *
+ * @param size a pointer to a function that takes a pointer to a key and
+ * returns the number of bytes in it (for strings, including the terminator)
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create_counter(size_t (*size)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *));
+
+
 /**
  * Returns the number of (key, value) pairs in the given map.
  *
@@ -50,6 +89,64 @@ size_t gmap_size(const gmap *m);
  */
 void *gmap_put(gmap *m, const void *key, void *value);
 
+/**
+ * Returns the value associated with the given key, first adding a copy
+ * of the key with the given value if it is not present.  The key is
+ * hashed once and its position in the table is found once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param value a pointer to the value to add if key is not present
+ * @return the existing value, or value if it was added, or a pointer to gmap_error
+ */
+void *gmap_get_or_put(gmap *m, const void *key, void *value);
+
+
+/**
+ * Replaces the value associated with the given key by the result of
+ * calling update on the current value, adding a copy of the key first
+ * if it is not present.  The key is hashed once and its position in the
+ * table is found once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param update a pointer to a function that takes the current value (NULL
+ * if the key was not present), whether the key was present, and the extra
+ * argument, and returns the new value, non-NULL
+ * @param arg a pointer passed to update
+ * @return the new value, or a pointer to gmap_error
+ */
+void *gmap_upsert(gmap *m, const void *key, void *(*update)(void *, bool, void *), void *arg);
+
+
+/**
+ * Adds delta to the count of the given key in a map made by
+ * gmap_create_counter, first adding a copy of the key with a count of 0
+ * if it is not present.  The key is hashed once and its position in the
+ * table is found once.
+ *
+ * @param m a pointer to a map made by gmap_create_counter, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param delta the amount to add
+ * @return a pointer to the key's new count, or NULL if there was an
+ * allocation error or m is not a counting map
+ */
+int64_t *gmap_increment(gmap *m, const void *key, int64_t delta);
+
+
+/**
+ * Returns a handle to the value associated with the given key, or NULL if
+ * the key is not present.  The value can be read and replaced through the
+ * handle without another lookup.  The handle is valid until the next put,
+ * remove, or other change to the map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the stored value pointer, or NULL
+ */
+void **gmap_lookup(gmap *m, const void *key);
+
+
 /**
  * Removes the given key and its associated value from the given map if
  * the key is present.  The return value is NULL and there is no effect
@@ -103,6 +200,92 @@ void *gmap_get(gmap *m, const void *key);
 void gmap_for_each(gmap *m, void (*f)(const void *, void *, void *), void *arg);
 
 
+/**
+ * Calls the given function for each (key, value) pair in this map, as for
+ * gmap_for_each, with the buckets split into ranges visited by up to
+ * nthreads threads at once.  Each thread passes its own extra argument,
+ * args[t] for thread t, so a reduction such as a sum can accumulate into
+ * one context per thread without locking and combine the contexts once
+ * the call returns.  Which context a pair is passed with is unspecified:
+ * small maps, and backends that cannot split their buckets, use fewer
+ * threads and leave the other contexts untouched.  The call returns once
+ * every pair has been visited.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param f a pointer to a function that takes a key, a value, and an
+ * extra piece of information, that does not change the map, and that is
+ * safe to call from several threads at once, non-NULL
+ * @param args a pointer to an array of nthreads pointers
+ * @param nthreads the most threads to use, counting the calling thread
+ */
+void gmap_for_each_parallel(gmap *m, void (*f)(const void *, void *, void *), void **args, size_t nthreads);
+
+
+/**
+ * A cursor over the (key, value) pairs of a map.  It is an ordinary value
+ * that can live on the stack; its fields belong to the implementation.
+ * The map must not be changed while a cursor over it is in use; during
+ * an incremental resize that includes gmap_get and gmap_lookup, which
+ * move entries between tables.
+ */
+typedef struct gmap_iter
+{
+  gmap *m;
+  size_t bucket;
+  size_t end;
+  void *pos;
+} gmap_iter;
+
+
+/**
+ * Returns the number of buckets in the given map.  Buckets are numbered
+ * from 0, and gmap_iter_range can visit any contiguous range of them, for
+ * example to split one iteration over several threads.  The count only
+ * changes when the map is changed.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @return the number of buckets in the map
+ */
+size_t gmap_bucket_count(const gmap *m);
+
+
+/**
+ * Starts a cursor over every (key, value) pair in the given map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param it a pointer to a cursor to initialize, non-NULL
+ */
+void gmap_iter_begin(gmap *m, gmap_iter *it);
+
+
+/**
+ * Starts a cursor over the (key, value) pairs in buckets from (inclusive)
+ * to to (exclusive) of the given map.  Cursors over disjoint ranges visit
+ * disjoint pairs, and ranges covering 0 to gmap_bucket_count(m) together
+ * visit every pair once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param it a pointer to a cursor to initialize, non-NULL
+ * @param from the first bucket to visit
+ * @param to one past the last bucket to visit, at most gmap_bucket_count(m)
+ */
+void gmap_iter_range(gmap *m, gmap_iter *it, size_t from, size_t to);
+
+
+/**
+ * Advances the given cursor.  If there is another pair, its key and value
+ * are stored through key and value (either may be NULL) and the return
+ * value is true; otherwise the return value is false.  No memory is
+ * allocated and no function is called through a pointer.
+ *
+ * @param it a pointer to a cursor started by gmap_iter_begin or gmap_iter_range
+ * @param key a pointer to where to store a pointer to the key, or NULL
+ * @param value a pointer to where to store the value pointer, or NULL
+ * @return true if a pair was found, false if the cursor is finished
+ */
+bool gmap_iter_next(gmap_iter *it, const void **key, void **value);
+
+
 /**
  * Returns an array containing pointers to all of the keys in the
  * given map.  The return value is NULL if there was an error
@@ -118,6 +301,147 @@ void gmap_for_each(gmap *m, void (*f)(const void *, void *, void *), void *arg);
 const void **gmap_keys(gmap *m);
 
 
+/**
+ * Chooses whether this map resizes all at once or incrementally.  In
+ * incremental mode the old and new tables coexist after a resize and each
+ * later put, get, and remove moves a bounded amount of old entries, so no
+ * single operation pays for rehashing the whole map.  Turning the mode off
+ * finishes any resize in progress.  Backends that cannot resize
+ * incrementally always resize all at once and say so by returning false
+ * when asked for incremental mode.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param incremental true for incremental resizing, false for all at once
+ * @return true if the map now resizes as asked, false otherwise
+ */
+bool gmap_set_incremental_resize(gmap *m, bool incremental);
+
+
+/**
+ * Chooses whether this map keeps a Bloom filter of its keys' hash codes.
+ * With the filter, most searches for keys that are not present (by get,
+ * contains_key, lookup and remove) are answered from one cache line of
+ * the filter without walking a chain or calling the compare function.
+ * The filter takes about two bytes per bucket; it is updated by every put
+ * and rebuilt whenever the table is resized.  In incremental mode the new
+ * filter is filled as chains are moved and replaces the old one when the
+ * resize is done, so resizes still pause only for a few chains.  Removed
+ * keys stay in the filter until the next rebuild, so removals leave it
+ * less selective but never wrong.  Searches for keys that are present read the filter too,
+ * so it pays off when many searches miss.  Backends whose misses are
+ * already cheap ignore this setting.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param enabled true to keep a filter, false to discard it
+ * @return true if successful, false if the filter could not be allocated
+ */
+bool gmap_set_miss_filter(gmap *m, bool enabled);
+
+
+/**
+ * Makes room for at least n pairs in this map, so that putting them does
+ * not resize it again.  Any incremental resize in progress is finished
+ * first.  The map is unchanged if the larger table cannot be allocated.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param n the number of pairs to make room for
+ * @return true if successful, false if there was an allocation error
+ */
+bool gmap_reserve(gmap *m, size_t n);
+
+
+/**
+ * Shrinks this map's table to the smallest capacity that holds its
+ * current pairs (but not below the initial capacity) and moves its
+ * entries into freshly allocated memory so that space left behind by
+ * removals is returned.  Pointers to keys obtained from the map become
+ * invalid for maps made by gmap_create_bytes.  The map is unchanged if
+ * the new memory cannot be allocated.
+ *
+ * @param m a pointer to a map, non-NULL
+ */
+void gmap_shrink_to_fit(gmap *m);
+
+
+/**
+ * A key and its value, for adding many pairs at once with
+ * gmap_build_parallel.
+ */
+typedef struct gmap_pair
+{
+  const void *key;
+  void *value;
+} gmap_pair;
+
+
+/**
+ * Adds copies of the given keys with their values to this empty map,
+ * spreading the work over up to nthreads threads.  The result is the same
+ * as putting the pairs one at a time in order, so a later pair replaces
+ * the value of an earlier one with an equal key.  The map's hash, compare
+ * and copy functions are called from several threads at once and must be
+ * safe to call that way.  Backends that cannot build in parallel, and
+ * inputs too small to be worth the threads, put the pairs one at a time.
+ *
+ * @param m a pointer to an empty map, non-NULL
+ * @param pairs a pointer to an array of n pairs with non-NULL keys
+ * @param n the number of pairs
+ * @param nthreads the most threads to use, counting the calling thread
+ * @return true if successful, false if m was not empty or there was an
+ * allocation error, in which case m holds some of the pairs
+ */
+bool gmap_build_parallel(gmap *m, const gmap_pair *pairs, size_t n, size_t nthreads);
+
+
+// lengths of this many or more share the last entry of gmap_stats.histogram
+#define GMAP_STATS_HISTOGRAM 8
+
+/**
+ * A summary of a map's shape and memory, and of the work done by its
+ * lookups and resizes.  The shape and memory fields are always filled in;
+ * the hits through resize_seconds counters are only kept when the map
+ * implementation is compiled with GMAP_STATS defined, and are 0 otherwise,
+ * so a normal build pays nothing for them.
+ *
+ * A probe is one chain node visited by the chained map, or one group of
+ * slots visited by the open-addressed map.
+ */
+typedef struct gmap_stats
+{
+  size_t size;
+  size_t buckets;
+  double load_factor;
+  // chained: number of chains of each length;
+  // open addressing: number of keys found after each number of probes
+  size_t histogram[GMAP_STATS_HISTOGRAM];
+  size_t longest;
+  // searches for a key (by put, get, contains_key, ...) that found it, and their probes
+  size_t hits;
+  size_t hit_probes;
+  // searches that did not find the key, and their probes
+  size_t misses;
+  size_t miss_probes;
+  size_t resizes;
+  double resize_seconds;
+  // bytes held by the bucket array, by entries (including keys stored in
+  // them), and by key copies kept apart from the entries (maps made by
+  // gmap_create_bytes only; other maps report 0)
+  size_t table_bytes;
+  size_t node_bytes;
+  size_t key_bytes;
+} gmap_stats;
+
+
+/**
+ * Fills in the given statistics for the given map.  This visits every
+ * entry, so it takes time proportional to the size of the map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param stats a pointer to the statistics to fill in, non-NULL
+ */
+void gmap_get_stats(const gmap *m, gmap_stats *stats);
+
+
 /**
  * Destroys the given map.  There is no effect if the given pointer is NULL.
  *
@@ -0,0 +1,547 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "gmap.h"
+#include "gmap_test_functions.h"
+#include "string_key.h"
+
+/**
+ * Times a gmap backend over a sweep of map sizes, key lengths, and hash
+ * functions, and reports each measurement as a CSV or JSON row.
+ *
+ * USAGE: GmapBench [-format csv|json] [-sizes n,...] [-lengths len,...]
+ *                  [-hashes name,...] [-ops n]
+ *
+ * For each (size, key length, hash function) the map is a
+ * gmap_create_bytes map of string keys of exactly that length: a common
+ * prefix and the key's index at the end.  The workloads, run in order on
+ * the same map, are
+ *
+ *   put        put each of the size keys into an empty map, shuffled
+ *   get-hitP   ops gets of uniformly chosen keys, P percent of them present
+ *              (P = 100, 90, 50, 0)
+ *   get-zipf   ops gets of present keys with Zipfian (s = 0.99) popularity
+ *   churn      ops removes and puts, half each, of keys chosen uniformly
+ *              from twice as many as the map started with
+ *
+ * Each row gives the time per operation, the throughput in millions of
+ * operations per second, the calls to malloc, calloc and realloc per
+ * operation, and the peak resident set size so far.  Each (size, length,
+ * hash) group runs in its own child process so the peak RSS is the
+ * group's own.  The first column is the name the program was run as, so
+ * output from GmapBench (gmap.c) and GmapBenchFlat (gmap_flat.c) can be
+ * concatenated and compared.
+ */
+
+#define DEFAULT_OPS 1000000
+#define MAX_LIST 16
+#define MIN_KEY_LENGTH 8
+
+// exponent of the Zipfian distribution
+#define ZIPF_S 0.99
+
+typedef struct _hash_function
+{
+  const char *name;
+  size_t (*hash)(const void *);
+} hash_function;
+
+static const hash_function functions[] = {
+  {"wy", hash_string_wy},
+  {"xx", hash_string_xx},
+  {"hash29", hash29},
+  {"java", java_hash_string},
+};
+#define NFUNCTIONS (sizeof(functions) / sizeof(functions[0]))
+
+typedef struct _bench_config
+{
+  const char *bench;
+  bool json;
+  size_t ops;
+} bench_config;
+
+typedef struct _group
+{
+  size_t n;
+  size_t len;
+  const hash_function *f;
+} group;
+
+// calls to the allocation functions, counted by the wrappers below
+static size_t allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t n, size_t size);
+void *__wrap_realloc(void *p, size_t size);
+
+size_t parse_list(const char *s, size_t *list);
+size_t parse_hashes(const char *s, const hash_function **list);
+bool run_group(const bench_config *config, const group *g, bool first);
+void print_row(const bench_config *config, const group *g, const char *workload, size_t ops, double secs, size_t allocs, bool first);
+char *make_keys(size_t len, size_t count);
+const char **choose_uniform(char *keys, size_t len, size_t n, size_t ops, size_t hit_percent, uint64_t *rng);
+const char **choose_zipf(char *keys, size_t len, size_t n, const size_t *order, size_t ops, uint64_t *rng);
+void shuffle(size_t *order, size_t n, uint64_t *rng);
+uint64_t next_random(uint64_t *rng);
+double seconds_since(const struct timespec *start);
+
+int main(int argc, char **argv)
+{
+  size_t sizes[MAX_LIST] = {1000, 100000, 1000000};
+  size_t nsizes = 3;
+  size_t lengths[MAX_LIST] = {8, 31, 64};
+  size_t nlengths = 3;
+  const hash_function *hashes[MAX_LIST];
+  size_t nhashes = NFUNCTIONS;
+  for (size_t f = 0; f < NFUNCTIONS; f++)
+    {
+      hashes[f] = &functions[f];
+    }
+
+  const char *bench = strrchr(argv[0], '/');
+  bench_config config = {bench == NULL ? argv[0] : bench + 1, false, DEFAULT_OPS};
+
+  int arg = 1;
+  bool ok = true;
+  while (ok && arg < argc)
+    {
+      if (arg + 1 == argc)
+	{
+	  ok = false;
+	}
+      else if (strcmp(argv[arg], "-format") == 0)
+	{
+	  config.json = strcmp(argv[arg + 1], "json") == 0;
+	  ok = config.json || strcmp(argv[arg + 1], "csv") == 0;
+	}
+      else if (strcmp(argv[arg], "-sizes") == 0)
+	{
+	  ok = (nsizes = parse_list(argv[arg + 1], sizes)) > 0;
+	}
+      else if (strcmp(argv[arg], "-lengths") == 0)
+	{
+	  ok = (nlengths = parse_list(argv[arg + 1], lengths)) > 0;
+	  for (size_t i = 0; i < nlengths; i++)
+	    {
+	      ok = ok && lengths[i] >= MIN_KEY_LENGTH;
+	    }
+	}
+      else if (strcmp(argv[arg], "-hashes") == 0)
+	{
+	  ok = (nhashes = parse_hashes(argv[arg + 1], hashes)) > 0;
+	}
+      else if (strcmp(argv[arg], "-ops") == 0)
+	{
+	  ok = (config.ops = strtoul(argv[arg + 1], NULL, 0)) > 0;
+	}
+      else
+	{
+	  ok = false;
+	}
+      arg += 2;
+    }
+  if (!ok)
+    {
+      fprintf(stderr, "USAGE: %s [-format csv|json] [-sizes n,...] [-lengths len,...] [-hashes name,...] [-ops n]\n", argv[0]);
+      fprintf(stderr, "  sizes are positive, lengths at least %d, hashes among", MIN_KEY_LENGTH);
+      for (size_t f = 0; f < NFUNCTIONS; f++)
+	{
+	  fprintf(stderr, " %s", functions[f].name);
+	}
+      fprintf(stderr, "\n");
+      return 1;
+    }
+
+  if (config.json)
+    {
+      printf("[\n");
+    }
+  else
+    {
+      printf("bench,size,key_length,hash,workload,ops,ns_per_op,mops_per_sec,allocs_per_op,peak_rss_kb\n");
+    }
+
+  bool first = true;
+  int status = 0;
+  for (size_t s = 0; s < nsizes; s++)
+    {
+      for (size_t l = 0; l < nlengths; l++)
+	{
+	  for (size_t h = 0; h < nhashes; h++)
+	    {
+	      group g = {sizes[s], lengths[l], hashes[h]};
+
+	      // the child's stdout starts with whatever the parent has not flushed
+	      fflush(stdout);
+	      pid_t pid = fork();
+	      if (pid == 0)
+		{
+		  bool done = run_group(&config, &g, first);
+		  fflush(stdout);
+		  _exit(done ? 0 : 1);
+		}
+
+	      int child = 1;
+	      if (pid < 0 || waitpid(pid, &child, 0) < 0 || !WIFEXITED(child) || WEXITSTATUS(child) != 0)
+		{
+		  fprintf(stderr, "%s: size %zu, length %zu, hash %s failed\n", config.bench, g.n, g.len, g.f->name);
+		  status = 1;
+		}
+	      else
+		{
+		  first = false;
+		}
+	    }
+	}
+    }
+
+  if (config.json)
+    {
+      printf("\n]\n");
+    }
+  return status;
+}
+
+/**
+ * Runs every workload for the given group and prints a row for each.
+ * Returns false if there was an allocation error before any row was
+ * printed, and exits if there was one after.
+ */
+bool run_group(const bench_config *config, const group *g, bool first)
+{
+  size_t n = g->n;
+  size_t len = g->len;
+  size_t ops = config->ops;
+  uint64_t rng = 0x9E3779B97F4A7C15ULL ^ (n * 31 + len);
+
+  // keys [0, n) are put, keys [n, 2n) are the misses and the churn's extras
+  char *keys = make_keys(len, 2 * n);
+  size_t *order = malloc(sizeof(size_t) * n);
+  gmap *m = gmap_create_bytes(string_key_size, compare_keys, g->f->hash);
+  if (keys == NULL || order == NULL || m == NULL)
+    {
+      free(keys);
+      free(order);
+      gmap_destroy(m);
+      return false;
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+      order[i] = i;
+    }
+  shuffle(order, n, &rng);
+
+  volatile size_t sink = 0;
+  struct timespec start;
+  size_t before = allocations;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    {
+      sink += gmap_put(m, keys + order[i] * (len + 1), keys) != NULL;
+    }
+  double secs = seconds_since(&start);
+  print_row(config, g, "put", n, secs, allocations - before, first);
+  if (gmap_size(m) != n)
+    {
+      fprintf(stderr, "allocation error during put\n");
+      exit(1);
+    }
+
+  static const size_t hit_percents[] = {100, 90, 50, 0};
+  for (size_t p = 0; p < sizeof(hit_percents) / sizeof(hit_percents[0]); p++)
+    {
+      const char **chosen = choose_uniform(keys, len, n, ops, hit_percents[p], &rng);
+      if (chosen == NULL)
+	{
+	  fprintf(stderr, "could not allocate workload\n");
+	  exit(1);
+	}
+
+      before = allocations;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < ops; i++)
+	{
+	  sink += gmap_get(m, chosen[i]) != NULL;
+	}
+      secs = seconds_since(&start);
+
+      char workload[16];
+      snprintf(workload, sizeof(workload), "get-hit%zu", hit_percents[p]);
+      print_row(config, g, workload, ops, secs, allocations - before, false);
+      free(chosen);
+    }
+
+  const char **chosen = choose_zipf(keys, len, n, order, ops, &rng);
+  if (chosen == NULL)
+    {
+      fprintf(stderr, "could not allocate workload\n");
+      exit(1);
+    }
+  before = allocations;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ops; i++)
+    {
+      sink += gmap_get(m, chosen[i]) != NULL;
+    }
+  secs = seconds_since(&start);
+  print_row(config, g, "get-zipf", ops, secs, allocations - before, false);
+  free(chosen);
+
+  // even positions remove and odd positions put; with keys drawn from
+  // twice as many as are present the size stays near n
+  chosen = choose_uniform(keys, len, 2 * n, ops, 100, &rng);
+  if (chosen == NULL)
+    {
+      fprintf(stderr, "could not allocate workload\n");
+      exit(1);
+    }
+  before = allocations;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ops; i++)
+    {
+      if (i % 2 == 0)
+	{
+	  sink += gmap_remove(m, chosen[i]) != NULL;
+	}
+      else
+	{
+	  sink += gmap_put(m, chosen[i], keys) != NULL;
+	}
+    }
+  secs = seconds_since(&start);
+  print_row(config, g, "churn", ops, secs, allocations - before, false);
+  free(chosen);
+
+  gmap_destroy(m);
+  free(order);
+  free(keys);
+  return true;
+}
+
+void print_row(const bench_config *config, const group *g, const char *workload, size_t ops, double secs, size_t allocs, bool first)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double ns = secs * 1e9 / ops;
+  double mops = ops / secs / 1e6;
+  double allocs_per_op = (double)allocs / ops;
+
+  if (config->json)
+    {
+      printf("%s  {\"bench\": \"%s\", \"size\": %zu, \"key_length\": %zu, \"hash\": \"%s\", \"workload\": \"%s\", "
+	     "\"ops\": %zu, \"ns_per_op\": %.2f, \"mops_per_sec\": %.3f, \"allocs_per_op\": %.4f, \"peak_rss_kb\": %ld}",
+	     first ? "" : ",\n", config->bench, g->n, g->len, g->f->name, workload,
+	     ops, ns, mops, allocs_per_op, usage.ru_maxrss);
+    }
+  else
+    {
+      printf("%s,%zu,%zu,%s,%s,%zu,%.2f,%.3f,%.4f,%ld\n",
+	     config->bench, g->n, g->len, g->f->name, workload,
+	     ops, ns, mops, allocs_per_op, usage.ru_maxrss);
+    }
+}
+
+/**
+ * Returns count keys of the given length, each followed by its null
+ * terminator, in one array: key i starts at index i * (len + 1).
+ */
+char *make_keys(size_t len, size_t count)
+{
+  char *keys = malloc((len + 1) * count);
+  if (keys == NULL)
+    {
+      return NULL;
+    }
+  for (size_t i = 0; i < count; i++)
+    {
+      // a common prefix, as with generated ids, and the index in hex at the end
+      char *key = keys + i * (len + 1);
+      memset(key, 'k', len);
+      key[len] = '\0';
+      size_t rest = i;
+      for (size_t j = len; j > 0 && rest > 0; j--, rest >>= 4)
+	{
+	  key[j - 1] = "0123456789abcdef"[rest & 0xF];
+	}
+    }
+  return keys;
+}
+
+/**
+ * Returns ops keys chosen uniformly: hit_percent percent of them from
+ * keys [0, n) and the rest from keys [n, 2n).
+ */
+const char **choose_uniform(char *keys, size_t len, size_t n, size_t ops, size_t hit_percent, uint64_t *rng)
+{
+  const char **chosen = malloc(sizeof(char *) * ops);
+  if (chosen == NULL)
+    {
+      return NULL;
+    }
+  for (size_t i = 0; i < ops; i++)
+    {
+      size_t k = next_random(rng) % n;
+      if (next_random(rng) % 100 >= hit_percent)
+	{
+	  k += n;
+	}
+      chosen[i] = keys + k * (len + 1);
+    }
+  return chosen;
+}
+
+/**
+ * Returns ops keys from [0, n) chosen with Zipfian popularity: the key of
+ * rank r, which is key order[r], is chosen with probability proportional
+ * to 1 / (r + 1)^s.
+ */
+const char **choose_zipf(char *keys, size_t len, size_t n, const size_t *order, size_t ops, uint64_t *rng)
+{
+  const char **chosen = malloc(sizeof(char *) * ops);
+  double *cdf = malloc(sizeof(double) * n);
+  if (chosen == NULL || cdf == NULL)
+    {
+      free(chosen);
+      free(cdf);
+      return NULL;
+    }
+
+  double total = 0.0;
+  for (size_t r = 0; r < n; r++)
+    {
+      total += 1.0 / pow(r + 1, ZIPF_S);
+      cdf[r] = total;
+    }
+  for (size_t i = 0; i < ops; i++)
+    {
+      // the first rank whose cumulative weight reaches u
+      double u = (next_random(rng) >> 11) * (1.0 / 9007199254740992.0) * total;
+      size_t lo = 0;
+      size_t hi = n - 1;
+      while (lo < hi)
+	{
+	  size_t mid = lo + (hi - lo) / 2;
+	  if (cdf[mid] < u)
+	    {
+	      lo = mid + 1;
+	    }
+	  else
+	    {
+	      hi = mid;
+	    }
+	}
+      chosen[i] = keys + order[lo] * (len + 1);
+    }
+  free(cdf);
+  return chosen;
+}
+
+size_t parse_list(const char *s, size_t *list)
+{
+  size_t count = 0;
+  while (count < MAX_LIST)
+    {
+      char *end;
+      list[count] = strtoul(s, &end, 0);
+      if (end == s || list[count] == 0)
+	{
+	  return 0;
+	}
+      count++;
+      if (*end != ',')
+	{
+	  return *end == '\0' ? count : 0;
+	}
+      s = end + 1;
+    }
+  return 0;
+}
+
+size_t parse_hashes(const char *s, const hash_function **list)
+{
+  size_t count = 0;
+  while (count < MAX_LIST)
+    {
+      size_t len = strcspn(s, ",");
+      size_t f = 0;
+      while (f < NFUNCTIONS && (strlen(functions[f].name) != len || strncmp(functions[f].name, s, len) != 0))
+	{
+	  f++;
+	}
+      if (f == NFUNCTIONS)
+	{
+	  return 0;
+	}
+      list[count++] = &functions[f];
+      if (s[len] == '\0')
+	{
+	  return count;
+	}
+      s += len + 1;
+    }
+  return 0;
+}
+
+void shuffle(size_t *order, size_t n, uint64_t *rng)
+{
+  for (size_t i = n - 1; i > 0; i--)
+    {
+      size_t j = next_random(rng) % (i + 1);
+      size_t tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+}
+
+/**
+ * Returns the next value from a xorshift64* generator, so the workloads
+ * are the same from run to run and from backend to backend.
+ */
+uint64_t next_random(uint64_t *rng)
+{
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return *rng * 0x2545F4914F6CDD1DULL;
+}
+
+double seconds_since(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// the link wraps these (-Wl,--wrap=malloc,...), so every allocation by
+// the benchmark and the map goes through them
+void *__wrap_malloc(size_t size)
+{
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  allocations++;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+  allocations++;
+  return __real_realloc(p, size);
+}
@@ -0,0 +1,593 @@
+/* CPSC223 Fall 2022 hw4
+ * This file implements a thread-safe chained gmap.  Readers follow chains
+ * with acquire loads and never lock; writers lock the stripe that owns
+ * the key's buckets and publish new nodes with release stores.  A resize
+ * locks every stripe and relinks the existing nodes into a new table while
+ * readers may still be walking the old one.  Removed nodes and replaced
+ * tables are freed by epoch-based reclamation once no reader can reach
+ * them.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "gmap_concurrent.h"
+#include "slab.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+char *gmap_concurrent_error = "error";
+
+// must be powers of two, with the table never smaller than the stripe count,
+// so that every bucket belongs to exactly one stripe at every capacity
+#define GMAP_CONCURRENT_STRIPES 64
+#define GMAP_CONCURRENT_INITIAL_CAPACITY 128
+
+// readers are only ever in the current epoch or the one before, so the
+// retired lists and reader counts cycle through three slots
+#define GMAP_CONCURRENT_EPOCHS 3
+
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+// Nodes to implement chains as singly-linked lists; next and value are
+// read by lock-free readers, so they are only accessed atomically
+typedef struct _cnode
+{
+    void* key;
+    void* value;
+    size_t hash;
+    struct _cnode* next;
+    // link in the map's list of retired nodes
+    struct _cnode* retired;
+} cnode;
+
+// a table of chains; readers may keep using one after it is replaced
+typedef struct _ctable
+{
+    size_t cap;
+    // link in the map's list of retired tables
+    struct _ctable* retired;
+    cnode* buckets[];
+} ctable;
+
+// meta struct of the map
+struct _gmap_concurrent
+{
+    // current table, swapped by resize
+    ctable* table;
+    // number of key-value pairs, updated atomically
+    size_t nkey;
+    // writers hold stripe hash % GMAP_CONCURRENT_STRIPES, resize holds all
+    pthread_mutex_t stripes[GMAP_CONCURRENT_STRIPES];
+    // odd while a resize is relinking nodes; a lookup that misses checks it
+    // did not race with one, since a relinked node may lead it off its chain
+    size_t moving;
+    // held for reading by for_each; a resize only tries for it, so an
+    // iteration never sees a relinked node twice
+    pthread_rwlock_t iterating;
+    // the global epoch, and the number of lock-free readers that entered
+    // in each epoch (slot epoch % GMAP_CONCURRENT_EPOCHS)
+    size_t epoch;
+    size_t active[GMAP_CONCURRENT_EPOCHS];
+    // guards the retired lists, one per epoch in which their entries were
+    // unlinked, and advancing the epoch
+    pthread_mutex_t retire_lock;
+    cnode* retired_nodes[GMAP_CONCURRENT_EPOCHS];
+    ctable* retired_tables[GMAP_CONCURRENT_EPOCHS];
+    // allocators for the counts of a map made by gmap_concurrent_create_counter,
+    // one per stripe and used under its lock; all NULL for other maps
+    slab* counts[GMAP_CONCURRENT_STRIPES];
+    // function pointers :
+    void* (*copier)(const void *);
+    int (*comparer)(const void *, const void *);
+    size_t (*hasher)(const void *);
+    void (*freer)(void *);
+};
+
+// helper function declarations
+static size_t gmap_concurrent_hash(const gmap_concurrent* m, const void* key);
+static ctable* ctable_create(size_t cap);
+static cnode* gmap_concurrent_find(const gmap_concurrent* m, const void* key, size_t hash);
+static void gmap_concurrent_resize(gmap_concurrent* m, size_t cap);
+static bool gmap_concurrent_add(gmap_concurrent* m, ctable* t, const void* key, size_t hash, void* value);
+static size_t gmap_concurrent_enter(const gmap_concurrent* m);
+static void gmap_concurrent_leave(const gmap_concurrent* m, size_t e);
+static void gmap_concurrent_retire(gmap_concurrent* m, cnode* n, ctable* t);
+static void gmap_concurrent_free_retired(gmap_concurrent* m, cnode* nodes, ctable* tables);
+static void gmap_concurrent_free_table(gmap_concurrent* m, ctable* t);
+
+gmap_concurrent *gmap_concurrent_create(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *s), void (*f)(void *))
+{
+    if (h == NULL || cp == NULL || comp == NULL || f == NULL)
+    {
+      // one of the required functions was missing
+      return NULL;
+    }
+
+    gmap_concurrent* m = calloc(1, sizeof(*m));
+    if (m == NULL)
+        return NULL;
+
+    m->table = ctable_create(GMAP_CONCURRENT_INITIAL_CAPACITY);
+    if (m->table == NULL)
+    {
+        free(m);
+        return NULL;
+    }
+    m->nkey = 0;
+    for (int i = 0; i < GMAP_CONCURRENT_STRIPES; i++)
+        pthread_mutex_init(&m->stripes[i], NULL);
+    pthread_rwlock_init(&m->iterating, NULL);
+    pthread_mutex_init(&m->retire_lock, NULL);
+    m->copier = cp;
+    m->comparer = comp;
+    m->hasher = h;
+    m->freer = f;
+    return m;
+}
+
+gmap_concurrent *gmap_concurrent_create_counter(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *s), void (*f)(void *))
+{
+    gmap_concurrent* m = gmap_concurrent_create(cp, comp, h, f);
+    if (m == NULL)
+        return NULL;
+
+    bool ok = true;
+    for (int i = 0; i < GMAP_CONCURRENT_STRIPES; i++)
+    {
+        m->counts[i] = slab_create(sizeof(int64_t));
+        ok = ok && m->counts[i] != NULL;
+    }
+    if (!ok)
+    {
+        gmap_concurrent_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+size_t gmap_concurrent_size(const gmap_concurrent *m)
+{
+    if (m == NULL)
+        return 0;
+    return __atomic_load_n(&m->nkey, __ATOMIC_RELAXED);
+}
+
+void *gmap_concurrent_put(gmap_concurrent *m, const void *key, void *value)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+    if (m->counts[0] != NULL)
+        return gmap_concurrent_error;
+
+    size_t hash = gmap_concurrent_hash(m, key);
+    pthread_mutex_t* stripe = &m->stripes[hash % GMAP_CONCURRENT_STRIPES];
+    pthread_mutex_lock(stripe);
+
+    // the table cannot be swapped while we hold a stripe
+    ctable* t = m->table;
+    cnode** head = &t->buckets[hash & (t->cap - 1)];
+    for (cnode* curr = *head; curr != NULL; curr = curr->next)
+    {
+        if (curr->hash == hash && m->comparer(key, curr->key) == 0)
+        {
+            // key is already present; readers see either value
+            void* oldvalue = __atomic_exchange_n(&curr->value, value, __ATOMIC_ACQ_REL);
+            pthread_mutex_unlock(stripe);
+            return oldvalue;
+        }
+    }
+
+    return gmap_concurrent_add(m, t, key, hash, value) ? NULL : gmap_concurrent_error;
+}
+
+bool gmap_concurrent_increment(gmap_concurrent *m, const void *key, int64_t delta)
+{
+    if (m == NULL || key == NULL || m->counts[0] == NULL)
+        return false;
+
+    // a resize relinks the node with its count, so adding to one found
+    // during a resize still counts
+    size_t hash = gmap_concurrent_hash(m, key);
+    size_t e = gmap_concurrent_enter(m);
+    cnode* found = gmap_concurrent_find(m, key, hash);
+    if (found != NULL)
+        __atomic_add_fetch((int64_t*)LOAD(&found->value), delta, __ATOMIC_RELAXED);
+    gmap_concurrent_leave(m, e);
+    if (found != NULL)
+        return true;
+
+    // not there yet: look again under the lock in case another thread added it
+    size_t s = hash % GMAP_CONCURRENT_STRIPES;
+    pthread_mutex_lock(&m->stripes[s]);
+    ctable* t = m->table;
+    for (cnode* curr = t->buckets[hash & (t->cap - 1)]; curr != NULL; curr = curr->next)
+    {
+        if (curr->hash == hash && m->comparer(key, curr->key) == 0)
+        {
+            __atomic_add_fetch((int64_t*)curr->value, delta, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&m->stripes[s]);
+            return true;
+        }
+    }
+
+    int64_t* count = slab_alloc(m->counts[s]);
+    if (count == NULL)
+    {
+        pthread_mutex_unlock(&m->stripes[s]);
+        return false;
+    }
+    *count = delta;
+    if (!gmap_concurrent_add(m, t, key, hash, count))
+    {
+        // gmap_concurrent_add has already released the stripe
+        pthread_mutex_lock(&m->stripes[s]);
+        slab_free(m->counts[s], count);
+        pthread_mutex_unlock(&m->stripes[s]);
+        return false;
+    }
+    return true;
+}
+
+void *gmap_concurrent_remove(gmap_concurrent *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    size_t hash = gmap_concurrent_hash(m, key);
+    pthread_mutex_t* stripe = &m->stripes[hash % GMAP_CONCURRENT_STRIPES];
+    pthread_mutex_lock(stripe);
+
+    ctable* t = m->table;
+    cnode** link = &t->buckets[hash & (t->cap - 1)];
+    cnode* removed = NULL;
+    for (cnode* curr = *link; curr != NULL; link = &curr->next, curr = curr->next)
+    {
+        if (curr->hash == hash && m->comparer(key, curr->key) == 0)
+        {
+            // readers already on curr can still follow its next pointer
+            STORE(link, curr->next);
+            __atomic_sub_fetch(&m->nkey, 1, __ATOMIC_RELAXED);
+            removed = curr;
+            break;
+        }
+    }
+    pthread_mutex_unlock(stripe);
+
+    if (removed == NULL)
+        return NULL;
+    // a counter map's count is freed with the retired node
+    void* result = m->counts[0] == NULL ? removed->value : NULL;
+    gmap_concurrent_retire(m, removed, NULL);
+    return result;
+}
+
+bool gmap_concurrent_contains_key(const gmap_concurrent *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return false;
+
+    size_t hash = gmap_concurrent_hash(m, key);
+    size_t e = gmap_concurrent_enter(m);
+    bool found = gmap_concurrent_find(m, key, hash) != NULL;
+    gmap_concurrent_leave(m, e);
+    return found;
+}
+
+void *gmap_concurrent_get(const gmap_concurrent *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    size_t hash = gmap_concurrent_hash(m, key);
+    size_t e = gmap_concurrent_enter(m);
+    cnode* n = gmap_concurrent_find(m, key, hash);
+    void* value = n == NULL ? NULL : LOAD(&n->value);
+    gmap_concurrent_leave(m, e);
+    return value;
+}
+
+void gmap_concurrent_for_each(const gmap_concurrent *m, void (*f)(const void *, void *, void *), void *arg)
+{
+    if (m == NULL || f == NULL)
+        return;
+
+    // the lock only keeps resizes out; it is never held for writing for long
+    pthread_rwlock_t* iterating = (pthread_rwlock_t*)&m->iterating;
+    pthread_rwlock_rdlock(iterating);
+    size_t e = gmap_concurrent_enter(m);
+    ctable* t = LOAD(&m->table);
+    for (size_t i = 0; i < t->cap; i++)
+    {
+        for (cnode* curr = LOAD(&t->buckets[i]); curr != NULL; curr = LOAD(&curr->next))
+            f(curr->key, LOAD(&curr->value), arg);
+    }
+    gmap_concurrent_leave(m, e);
+    pthread_rwlock_unlock(iterating);
+}
+
+void gmap_concurrent_destroy(gmap_concurrent *m)
+{
+    if (m != NULL)
+    {
+        for (int i = 0; i < GMAP_CONCURRENT_EPOCHS; i++)
+            gmap_concurrent_free_retired(m, m->retired_nodes[i], m->retired_tables[i]);
+        gmap_concurrent_free_table(m, m->table);
+        for (int i = 0; i < GMAP_CONCURRENT_STRIPES; i++)
+        {
+            pthread_mutex_destroy(&m->stripes[i]);
+            slab_destroy(m->counts[i]);
+        }
+        pthread_rwlock_destroy(&m->iterating);
+        pthread_mutex_destroy(&m->retire_lock);
+        free(m);
+    }
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+
+/**
+ * Returns the user's hash of key passed through a 64-bit finalizer, since
+ * bucket indices come from the low bits.
+ */
+static size_t gmap_concurrent_hash(const gmap_concurrent* m, const void* key)
+{
+    uint64_t h = (uint64_t)m->hasher(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+/*
+ * Allocate a table with cap empty chains
+ */
+static ctable* ctable_create(size_t cap)
+{
+    ctable* t = calloc(1, sizeof(ctable) + cap * sizeof(cnode*));
+    if (t != NULL)
+        t->cap = cap;
+    return t;
+}
+
+/**
+ * Returns the node holding key in the current table, or NULL.  Must be
+ * called between gmap_concurrent_enter and gmap_concurrent_leave, so the
+ * nodes it passes are not freed.  Takes no locks unless it misses while a
+ * resize is relinking nodes, when it waits for the resize and looks again.
+ */
+static cnode* gmap_concurrent_find(const gmap_concurrent* m, const void* key, size_t hash)
+{
+    while (true)
+    {
+        size_t moving = LOAD(&m->moving);
+        if (moving % 2 == 0)
+        {
+            ctable* t = LOAD(&m->table);
+            cnode* curr = LOAD(&t->buckets[hash & (t->cap - 1)]);
+            while (curr != NULL)
+            {
+                if (curr->hash == hash && m->comparer(key, curr->key) == 0)
+                    return curr;
+                curr = LOAD(&curr->next);
+            }
+
+            // having seen any link a resize changed, we see its count too
+            if (LOAD(&m->moving) == moving)
+                return NULL;
+        }
+
+        // a resize holds every stripe until it is done
+        pthread_mutex_t* stripe = (pthread_mutex_t*)&m->stripes[hash % GMAP_CONCURRENT_STRIPES];
+        pthread_mutex_lock(stripe);
+        pthread_mutex_unlock(stripe);
+    }
+}
+
+/*
+ * Grow the table to cap chains unless another thread already did, moving
+ * each node to the head of its new chain.  A reader on a node that moves
+ * follows it into the new table, so lookups that miss while nodes are
+ * moving look again.  Skipped, to be tried again by a later add, while an
+ * iteration is running.  The old table is retired.
+ */
+static void gmap_concurrent_resize(gmap_concurrent* m, size_t cap)
+{
+    if (pthread_rwlock_trywrlock(&m->iterating) != 0)
+        return;
+
+    // always lock stripes in the same order
+    for (int i = 0; i < GMAP_CONCURRENT_STRIPES; i++)
+        pthread_mutex_lock(&m->stripes[i]);
+
+    ctable* old = m->table;
+    ctable* t = old->cap < cap ? ctable_create(cap) : NULL;
+    if (t != NULL)
+    {
+        // the links below are release stores, so a reader that sees one
+        // sees that nodes are moving
+        __atomic_add_fetch(&m->moving, 1, __ATOMIC_RELAXED);
+        for (size_t i = 0; i < old->cap; i++)
+        {
+            cnode* curr = old->buckets[i];
+            while (curr != NULL)
+            {
+                cnode* next = curr->next;
+                cnode** head = &t->buckets[curr->hash & (cap - 1)];
+                STORE(&curr->next, *head);
+                *head = curr;
+                curr = next;
+            }
+        }
+        STORE(&m->table, t);
+        __atomic_add_fetch(&m->moving, 1, __ATOMIC_RELEASE);
+    }
+
+    for (int i = GMAP_CONCURRENT_STRIPES - 1; i >= 0; i--)
+        pthread_mutex_unlock(&m->stripes[i]);
+    pthread_rwlock_unlock(&m->iterating);
+
+    if (t != NULL)
+        gmap_concurrent_retire(m, NULL, old);
+}
+
+/*
+ * Add a node for a copy of key with the given value to the head of its
+ * chain in t, which is the current table, then release the key's stripe
+ * (held by the caller) and grow the table if the load factor is over 1.
+ * Returns false, after releasing the stripe, if there was an allocation
+ * error.
+ */
+static bool gmap_concurrent_add(gmap_concurrent* m, ctable* t, const void* key, size_t hash, void* value)
+{
+    pthread_mutex_t* stripe = &m->stripes[hash % GMAP_CONCURRENT_STRIPES];
+    cnode** head = &t->buckets[hash & (t->cap - 1)];
+
+    void* keycopy = m->copier(key);
+    cnode* newnode = malloc(sizeof(cnode));
+    if (keycopy == NULL || newnode == NULL)
+    {
+        pthread_mutex_unlock(stripe);
+        if (keycopy != NULL) m->freer(keycopy);
+        free(newnode);
+        return false;
+    }
+    newnode->key = keycopy;
+    newnode->value = value;
+    newnode->hash = hash;
+    newnode->next = *head;
+    newnode->retired = NULL;
+
+    // publish the fully built node at the head of the chain
+    STORE(head, newnode);
+    size_t n = __atomic_add_fetch(&m->nkey, 1, __ATOMIC_RELAXED);
+    size_t cap = t->cap;
+    pthread_mutex_unlock(stripe);
+
+    // resize if load factor > 1
+    if (n > cap)
+        gmap_concurrent_resize(m, cap * 2);
+    return true;
+}
+
+/*
+ * Start a lock-free read of the map, returning the epoch to pass to
+ * gmap_concurrent_leave.  Nothing retired after this returns is freed
+ * before the matching leave.
+ */
+static size_t gmap_concurrent_enter(const gmap_concurrent* m)
+{
+    size_t* active = (size_t*)m->active;
+    while (true)
+    {
+        size_t e = __atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&active[e % GMAP_CONCURRENT_EPOCHS], 1, __ATOMIC_SEQ_CST);
+        // counted too late if the epoch moved on in between
+        if (__atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST) == e)
+            return e;
+        __atomic_sub_fetch(&active[e % GMAP_CONCURRENT_EPOCHS], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+ * End a read started by gmap_concurrent_enter in epoch e
+ */
+static void gmap_concurrent_leave(const gmap_concurrent* m, size_t e)
+{
+    size_t* active = (size_t*)m->active;
+    __atomic_sub_fetch(&active[e % GMAP_CONCURRENT_EPOCHS], 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Put a node unlinked from its chain and a table replaced by a resize,
+ * either of which may be NULL, on the retired lists of the current epoch.
+ * Then, if no reader from the epoch before is left, advance the epoch and
+ * free what was retired in that one: every reader left started after it
+ * was unlinked.  Must not be called while holding a stripe.
+ */
+static void gmap_concurrent_retire(gmap_concurrent* m, cnode* n, ctable* t)
+{
+    pthread_mutex_lock(&m->retire_lock);
+    size_t e = __atomic_load_n(&m->epoch, __ATOMIC_SEQ_CST);
+    size_t now = e % GMAP_CONCURRENT_EPOCHS;
+    if (n != NULL)
+    {
+        n->retired = m->retired_nodes[now];
+        m->retired_nodes[now] = n;
+    }
+    if (t != NULL)
+    {
+        t->retired = m->retired_tables[now];
+        m->retired_tables[now] = t;
+    }
+
+    cnode* nodes = NULL;
+    ctable* tables = NULL;
+    size_t before = (e + GMAP_CONCURRENT_EPOCHS - 1) % GMAP_CONCURRENT_EPOCHS;
+    if (__atomic_load_n(&m->active[before], __ATOMIC_SEQ_CST) == 0)
+    {
+        __atomic_store_n(&m->epoch, e + 1, __ATOMIC_SEQ_CST);
+        nodes = m->retired_nodes[before];
+        tables = m->retired_tables[before];
+        m->retired_nodes[before] = NULL;
+        m->retired_tables[before] = NULL;
+    }
+    pthread_mutex_unlock(&m->retire_lock);
+
+    gmap_concurrent_free_retired(m, nodes, tables);
+}
+
+/*
+ * Free the given lists of retired nodes, with their keys and any counts,
+ * and of retired tables
+ */
+static void gmap_concurrent_free_retired(gmap_concurrent* m, cnode* nodes, ctable* tables)
+{
+    while (nodes != NULL)
+    {
+        cnode* next = nodes->retired;
+        m->freer(nodes->key);
+        if (m->counts[0] != NULL)
+        {
+            size_t s = nodes->hash % GMAP_CONCURRENT_STRIPES;
+            pthread_mutex_lock(&m->stripes[s]);
+            slab_free(m->counts[s], nodes->value);
+            pthread_mutex_unlock(&m->stripes[s]);
+        }
+        free(nodes);
+        nodes = next;
+    }
+
+    while (tables != NULL)
+    {
+        ctable* next = tables->retired;
+        free(tables);
+        tables = next;
+    }
+}
+
+/*
+ * Free a table along with its nodes and their keys
+ */
+static void gmap_concurrent_free_table(gmap_concurrent* m, ctable* t)
+{
+    for (size_t i = 0; i < t->cap; i++)
+    {
+        cnode* curr = t->buckets[i];
+        while (curr != NULL)
+        {
+            cnode* next = curr->next;
+            m->freer(curr->key);
+            free(curr);
+            curr = next;
+        }
+    }
+    free(t);
+}
@@ -0,0 +1,157 @@
+#ifndef __GMAP_CONCURRENT_H__
+#define __GMAP_CONCURRENT_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A thread-safe variant of gmap.  Lookups take no locks; puts and
+ * removes lock one of a fixed set of stripes chosen by the key's hash,
+ * and resizing locks every stripe and moves the existing nodes into a
+ * larger table while readers continue.  A lookup that misses while nodes
+ * are being moved waits for the resize and looks again, and a resize is
+ * put off while an iteration is running.  Removed entries and replaced
+ * tables are freed by epoch-based reclamation once no lookup or iteration
+ * that might still reach them is running, so a thread that stays inside
+ * gmap_concurrent_for_each holds back everything removed meanwhile.
+ */
+struct _gmap_concurrent;
+typedef struct _gmap_concurrent gmap_concurrent;
+
+/**
+ * Used for gmap_concurrent_put to report an allocation error through its
+ * return value.
+ */
+extern char *gmap_concurrent_error;
+
+/**
+ * Creates an empty concurrent map that uses the given functions, which
+ * must be safe to call from several threads at once.
+ *
+ * @param cp a function that take a pointer to a key and returns a pointer to a deep copy of that key
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @param f a pointer to a function that takes a pointer to a copy of a key make by cp and frees it
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap_concurrent *gmap_concurrent_create(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *s), void (*f)(void *));
+
+
+/**
+ * Creates an empty concurrent map from keys to 64-bit counts, for
+ * counting keys such as words from several threads.  The map keeps the
+ * counts itself, and they are changed only by gmap_concurrent_increment.
+ * The value of a key, as returned by gmap_concurrent_get and
+ * gmap_concurrent_for_each, is a pointer to its int64_t count, which
+ * other threads may be adding to; read it with __atomic_load_n or once
+ * they are done.  The count is freed some time after its key is removed.  gmap_concurrent_put fails on these maps and
+ * gmap_concurrent_remove returns NULL.
+ *
+ * @param cp a function that take a pointer to a key and returns a pointer to a deep copy of that key
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @param f a pointer to a function that takes a pointer to a copy of a key make by cp and frees it
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap_concurrent *gmap_concurrent_create_counter(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *s), void (*f)(void *));
+
+
+/**
+ * Returns the number of (key, value) pairs in the given map.  With
+ * concurrent writers the result may already be out of date.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @return the size of the map pointed to by m
+ */
+size_t gmap_concurrent_size(const gmap_concurrent *m);
+
+
+/**
+ * Adds a copy of the given key with value to this map, as for gmap_put.
+ * Safe to call concurrently with any other operation except destroy.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param value a pointer to a value
+ * @return a pointer to the old value, or NULL, or a pointer to gmap_concurrent_error
+ */
+void *gmap_concurrent_put(gmap_concurrent *m, const void *key, void *value);
+
+
+/**
+ * Atomically adds delta to the count of the given key in a map made by
+ * gmap_concurrent_create_counter, first adding a copy of the key with a
+ * count of 0 if it is not present.  A key already present is found and
+ * counted without locking.  Safe to call concurrently with any other
+ * operation except destroy.
+ *
+ * @param m a pointer to a map made by gmap_concurrent_create_counter, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param delta the amount to add
+ * @return true if successful, false if there was an allocation error or m
+ * is not a counting map
+ */
+bool gmap_concurrent_increment(gmap_concurrent *m, const void *key, int64_t delta);
+
+
+/**
+ * Removes the given key and its associated value from the given map, as
+ * for gmap_remove.  The map's copy of the key is freed once no other
+ * thread can be looking at it.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a key, non-NULL
+ * @return the value associated with the removed key, or NULL
+ */
+void *gmap_concurrent_remove(gmap_concurrent *m, const void *key);
+
+
+/**
+ * Determines if the given key is present in this map without locking.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return true if a key equal to the one pointed to is present in this map,
+ * false otherwise
+ */
+bool gmap_concurrent_contains_key(const gmap_concurrent *m, const void *key);
+
+
+/**
+ * Returns the value associated with the given key in this map without
+ * locking, or NULL if the key is not present.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the assocated value, or NULL if they key is not present
+ */
+void *gmap_concurrent_get(const gmap_concurrent *m, const void *key);
+
+
+/**
+ * Calls the given function for each (key, value) pair in this map.  Pairs
+ * put or removed by other threads during the call may or may not be seen;
+ * every other pair is seen once.  The map does not grow during the call.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param f a pointer to a function that takes a key, a value, and an
+ * extra piece of information, non-NULL
+ * @param arg a pointer
+ */
+void gmap_concurrent_for_each(const gmap_concurrent *m, void (*f)(const void *, void *, void *), void *arg);
+
+
+/**
+ * Destroys the given map.  There is no effect if the given pointer is NULL.
+ * Must only be called while no other thread is using the map.
+ *
+ * @param m a pointer to a map, or NULL
+ */
+void gmap_concurrent_destroy(gmap_concurrent *m);
+
+#endif
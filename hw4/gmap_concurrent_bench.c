@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "gmap_concurrent.h"
+#include "string_key.h"
+
+/**
+ * Multi-threaded throughput benchmark for gmap_concurrent.
+ *
+ * USAGE: GmapConcurrentBench [max-threads [keys [ops-per-run]]]
+ *
+ * First checks that threads inserting disjoint keys at the same time
+ * (forcing resizes under load) leave every key in the map, and that
+ * threads counting the same keys at the same time lose no counts.  Then,
+ * for each
+ * read percentage and each thread count from 1 to max-threads, runs a fixed
+ * total number of operations on random keys split evenly over the threads
+ * and prints one line of throughput.
+ */
+
+#define DEFAULT_MAX_THREADS 4
+#define DEFAULT_KEYS 100000
+#define DEFAULT_OPS 2000000
+// keys are "key" and a 13-digit index, with room for any size_t
+#define KEY_BUFFER 24
+
+typedef struct _worker
+{
+  gmap_concurrent *m;
+  char **keys;
+  size_t nkeys;
+  int *values;
+  size_t first;       // insert phase: keys [first, last)
+  size_t last;
+  size_t ops;         // mixed phase: number of operations
+  int read_percent;
+  unsigned int seed;
+  int delta;          // counting phase: amount added to every key
+} worker;
+
+char **make_keys(size_t n);
+void free_keys(char **keys, size_t n);
+size_t fnv_hash(const void *key);
+void *insert_range(void *arg);
+void *count_all(void *arg);
+void *mixed_ops(void *arg);
+double seconds_since(const struct timespec *start);
+int check_concurrent_inserts(int nthreads, size_t n);
+int check_concurrent_counts(int nthreads, size_t n);
+void run_mixed(int nthreads, int read_percent, size_t n, size_t ops);
+
+int main(int argc, char **argv)
+{
+  int max_threads = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_THREADS;
+  size_t n = argc > 2 ? (size_t)atol(argv[2]) : DEFAULT_KEYS;
+  size_t ops = argc > 3 ? (size_t)atol(argv[3]) : DEFAULT_OPS;
+
+  if (max_threads < 1 || n < 1)
+    {
+      fprintf(stderr, "USAGE: %s [max-threads [keys [ops-per-run]]]\n", argv[0]);
+      return 1;
+    }
+
+  if (!check_concurrent_inserts(max_threads, n) || !check_concurrent_counts(max_threads, n))
+    {
+      return 1;
+    }
+
+  printf("%8s %6s %12s\n", "threads", "read%", "Mops/s");
+  int read_percents[] = {100, 90, 50};
+  for (size_t r = 0; r < sizeof(read_percents) / sizeof(read_percents[0]); r++)
+    {
+      for (int t = 1; t <= max_threads; t++)
+	{
+	  run_mixed(t, read_percents[r], n, ops);
+	}
+    }
+  return 0;
+}
+
+int check_concurrent_inserts(int nthreads, size_t n)
+{
+  gmap_concurrent *m = gmap_concurrent_create(duplicate, compare_keys, fnv_hash, free);
+  char **keys = make_keys(n);
+  int *values = calloc(n, sizeof(int));
+  pthread_t threads[nthreads];
+  worker workers[nthreads];
+
+  for (int t = 0; t < nthreads; t++)
+    {
+      workers[t] = (worker){m, keys, n, values, n * t / nthreads, n * (t + 1) / nthreads, 0, 0, 0};
+      pthread_create(&threads[t], NULL, insert_range, &workers[t]);
+    }
+  for (int t = 0; t < nthreads; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+
+  int passed = gmap_concurrent_size(m) == n;
+  for (size_t i = 0; i < n && passed; i++)
+    {
+      passed = gmap_concurrent_get(m, keys[i]) == values + i;
+    }
+  printf("%s -- %d threads inserting %zu keys\n", passed ? "PASSED" : "FAILED", nthreads, n);
+
+  gmap_concurrent_destroy(m);
+  free_keys(keys, n);
+  free(values);
+  return passed;
+}
+
+int check_concurrent_counts(int nthreads, size_t n)
+{
+  gmap_concurrent *m = gmap_concurrent_create_counter(duplicate, compare_keys, fnv_hash, free);
+  char **keys = make_keys(n);
+  pthread_t threads[nthreads];
+  worker workers[nthreads];
+
+  // every thread counts every key, each starting at a different key
+  for (int t = 0; t < nthreads; t++)
+    {
+      workers[t] = (worker){m, keys, n, NULL, n * t / nthreads, 0, 0, 0, 0, t + 1};
+      pthread_create(&threads[t], NULL, count_all, &workers[t]);
+    }
+  for (int t = 0; t < nthreads; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+
+  int64_t expected = (int64_t)nthreads * (nthreads + 1) / 2;
+  int passed = gmap_concurrent_size(m) == n;
+  for (size_t i = 0; i < n && passed; i++)
+    {
+      int64_t *count = gmap_concurrent_get(m, keys[i]);
+      passed = count != NULL && *count == expected;
+    }
+  printf("%s -- %d threads counting %zu keys\n", passed ? "PASSED" : "FAILED", nthreads, n);
+
+  gmap_concurrent_destroy(m);
+  free_keys(keys, n);
+  return passed;
+}
+
+void run_mixed(int nthreads, int read_percent, size_t n, size_t ops)
+{
+  gmap_concurrent *m = gmap_concurrent_create(duplicate, compare_keys, fnv_hash, free);
+  char **keys = make_keys(n);
+  int *values = calloc(n, sizeof(int));
+  for (size_t i = 0; i < n; i++)
+    {
+      gmap_concurrent_put(m, keys[i], values + i);
+    }
+
+  pthread_t threads[nthreads];
+  worker workers[nthreads];
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int t = 0; t < nthreads; t++)
+    {
+      workers[t] = (worker){m, keys, n, values, 0, 0, ops / nthreads, read_percent, 12345u + t};
+      pthread_create(&threads[t], NULL, mixed_ops, &workers[t]);
+    }
+  for (int t = 0; t < nthreads; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+  double elapsed = seconds_since(&start);
+
+  printf("%8d %6d %12.2f\n", nthreads, read_percent, ops / elapsed / 1e6);
+
+  gmap_concurrent_destroy(m);
+  free_keys(keys, n);
+  free(values);
+}
+
+void *insert_range(void *arg)
+{
+  worker *w = arg;
+  for (size_t i = w->first; i < w->last; i++)
+    {
+      gmap_concurrent_put(w->m, w->keys[i], w->values + i);
+    }
+  return NULL;
+}
+
+void *count_all(void *arg)
+{
+  worker *w = arg;
+  for (size_t i = 0; i < w->nkeys; i++)
+    {
+      gmap_concurrent_increment(w->m, w->keys[(w->first + i) % w->nkeys], w->delta);
+    }
+  return NULL;
+}
+
+void *mixed_ops(void *arg)
+{
+  worker *w = arg;
+  for (size_t i = 0; i < w->ops; i++)
+    {
+      size_t k = rand_r(&w->seed) % w->nkeys;
+      int roll = rand_r(&w->seed) % 100;
+      if (roll < w->read_percent)
+	{
+	  gmap_concurrent_get(w->m, w->keys[k]);
+	}
+      else if (roll % 2 == 0)
+	{
+	  gmap_concurrent_put(w->m, w->keys[k], w->values + k);
+	}
+      else
+	{
+	  gmap_concurrent_remove(w->m, w->keys[k]);
+	}
+    }
+  return NULL;
+}
+
+char **make_keys(size_t n)
+{
+  char **keys = malloc(sizeof(char *) * n);
+  for (size_t i = 0; i < n; i++)
+    {
+      keys[i] = malloc(KEY_BUFFER);
+      snprintf(keys[i], KEY_BUFFER, "key%013zu", i);
+    }
+  return keys;
+}
+
+void free_keys(char **keys, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      free(keys[i]);
+    }
+  free(keys);
+}
+
+size_t fnv_hash(const void *key)
+{
+  // 64-bit FNV-1a
+  const unsigned char *s = key;
+  size_t hash = 14695981039346656037ULL;
+  while (*s != '\0')
+    {
+      hash ^= *s++;
+      hash *= 1099511628211ULL;
+    }
+  return hash;
+}
+
+double seconds_since(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
@@ -0,0 +1,1160 @@
+/* CPSC223 Fall 2022 hw4
+ * This file implements the gmap ADT as a flat open-addressed table.
+ * Keys and values live in one array of slots; a parallel array of one-byte
+ * control tags (7 bits of the hash, or EMPTY/DELETED) is probed 16 slots at
+ * a time, so a lookup usually touches one line of tags and one slot.
+ * It can be linked in place of gmap.c (see GmapUnitFlat in the makefile).
+ */
+
+#include "gmap.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "slab.h"
+
+#ifdef GMAP_STATS
+#include <time.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+char *gmap_error = "error";
+
+// control byte values; a full slot holds the low 7 bits of its hash
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+
+// number of slots whose control bytes are examined together
+#define GROUP_WIDTH 16
+
+// must be a power of two and a multiple of GROUP_WIDTH
+#define GMAP_INITIAL_CAPACITY 128
+
+// key copies of up to GMAP_MIN_KEY_CLASS << (GMAP_KEY_CLASSES - 1) bytes come from slabs
+#define GMAP_KEY_CLASSES 3
+#define GMAP_MIN_KEY_CLASS 16
+
+// a key-value pair held directly in the table
+typedef struct _slot
+{
+    void* key;
+    void* value;
+    // mixed hash code of key, kept so rehashing never calls the hasher
+    size_t hash;
+} slot;
+
+// meta struct of the map
+struct _gmap{
+    // one control byte per slot
+    uint8_t* ctrl;
+    // array of key-value pairs, parallel to ctrl
+    slot* slots;
+    // number of slots (power of two, multiple of GROUP_WIDTH)
+    size_t cap;
+    // number of key-value pairs in the table
+    size_t nkey;
+    // number of DELETED control bytes (tombstones)
+    size_t ndeleted;
+    // function pointers :
+    void* (*copier)(const void *);
+    int (*comparer)(const void *, const void *);
+    size_t (*hasher)(const void *);
+    void (*freer)(void *);
+    // size of a key in bytes for maps made by gmap_create_bytes, else NULL
+    size_t (*sizer)(const void *);
+    // allocators for short key copies by size class (gmap_create_bytes only)
+    slab* keys[GMAP_KEY_CLASSES];
+    // number of key copies too long for any class, held in the heap
+    size_t nbigkeys;
+    // allocator for the counts of a map made by gmap_create_counter, else NULL
+    slab* counts;
+#ifdef GMAP_STATS
+    // search and resize counters reported by gmap_get_stats
+    gmap_stats stats;
+#endif
+};
+
+// counters for gmap_get_stats; searches take a const map, hence the cast
+#ifdef GMAP_STATS
+#define GMAP_COUNT_SEARCH(m, found, probes) \
+    ((found) ? (((gmap*)(m))->stats.hits++, ((gmap*)(m))->stats.hit_probes += (probes)) \
+             : (((gmap*)(m))->stats.misses++, ((gmap*)(m))->stats.miss_probes += (probes)))
+#define GMAP_TIMER_START(t) clock_t t = clock()
+#define GMAP_TIMER_STOP(m, t) ((m)->stats.resize_seconds += (double)(clock() - (t)) / CLOCKS_PER_SEC)
+#define GMAP_COUNT_RESIZE(m) ((m)->stats.resizes++)
+#else
+#define GMAP_COUNT_SEARCH(m, found, probes) ((void)(probes))
+#define GMAP_TIMER_START(t)
+#define GMAP_TIMER_STOP(m, t) ((void)0)
+#define GMAP_COUNT_RESIZE(m) ((void)0)
+#endif
+
+// helper function declarations
+static size_t gmap_flat_hash(const gmap* m, const void* key);
+static size_t gmap_flat_find(const gmap* m, const void* key, size_t hash, size_t* free_index);
+static size_t gmap_flat_find_or_add(gmap* m, const void* key, bool* added);
+static size_t gmap_flat_find_free(const gmap* m, size_t hash);
+static bool gmap_flat_alloc(gmap* m, size_t cap);
+static bool gmap_flat_rehash(gmap* m, size_t newcap);
+static size_t gmap_flat_capacity(size_t n);
+static gmap* gmap_flat_create(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *), void (*f)(void *), size_t (*size)(const void *));
+static int gmap_key_class(size_t size);
+static void* gmap_copy_key(gmap* m, const void* key);
+static void gmap_free_key(gmap* m, void* key);
+
+// =================================================================================================================
+// Group matching (SSE2 with a portable fallback)
+// =================================================================================================================
+
+/**
+ * Returns a bitmask with bit i set if the i-th control byte in the group
+ * starting at g equals tag.
+ */
+static inline unsigned group_match(const uint8_t* g, uint8_t tag)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++)
+    {
+        if (g[i] == tag) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * Returns a bitmask with bit i set if the i-th control byte in the group
+ * starting at g is EMPTY or DELETED (both have the high bit set).
+ */
+static inline unsigned group_match_free(const uint8_t* g)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+    return (unsigned)_mm_movemask_epi8(ctrl);
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++)
+    {
+        if (g[i] & 0x80) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+// index of the lowest set bit in a non-zero mask
+#define LOWEST_BIT(mask) ((size_t)__builtin_ctz(mask))
+
+// the 7-bit tag kept in the control byte of a full slot
+#define HASH_TAG(hash) ((uint8_t)((hash) & 0x7F))
+
+// the group where the probe sequence for hash starts
+#define HASH_GROUP(hash) ((hash) >> 7)
+
+// =================================================================================================================
+// Required Function Implementations
+// =================================================================================================================
+/**
+ * Creates an empty map that uses the given hash function.
+ *
+ * @param cp a function that take a pointer to a key and returns a pointer to a deep copy of that key
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @param f a pointer to a function that takes a pointer to a copy of a key make by cp and frees it
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *s), void (*f)(void *))
+{
+    if (h == NULL || cp == NULL || comp == NULL || f == NULL)
+    {
+      // one of the required functions was missing
+      return NULL;
+    }
+
+    return gmap_flat_create(cp, comp, h, f, NULL);
+}
+
+
+/**
+ * Creates an empty map whose keys are self-contained blocks of bytes,
+ * such as strings.  The map copies keys itself, and short keys are kept
+ * in the map's own storage instead of being allocated one by one.
+ *
+ * @param size a pointer to a function that takes a pointer to a key and
+ * returns the number of bytes in it (for strings, including the terminator)
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create_bytes(size_t (*size)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *))
+{
+    if (size == NULL || comp == NULL || h == NULL)
+    {
+      // one of the required functions was missing
+      return NULL;
+    }
+
+    return gmap_flat_create(NULL, comp, h, NULL, size);
+}
+
+
+/**
+ * Creates an empty map from keys to 64-bit counts, for counting keys such
+ * as words.  Keys are copied as for gmap_create_bytes, and each count is
+ * kept in the map's own storage, so counting needs no allocation beyond
+ * the map's.  Counts are changed only by gmap_increment; the value of a
+ * key, as returned by gmap_get, gmap_for_each and the other functions
+ * that report values, is a pointer to its int64_t count, valid until the
+ * key is removed or the map is shrunk or destroyed.  gmap_put,
+ * gmap_get_or_put and gmap_upsert fail on these maps, and gmap_remove
+ * returns NULL.
+ *
+ * @param size a pointer to a function that takes a pointer to a key and
+ * returns the number of bytes in it (for strings, including the terminator)
+ * @param comp a pointer to a function that takes two keys and returns the result of comparing them,
+ * with return value as for strcmp
+ * @param h a pointer to a function that takes a pointer to a key and returns its hash code
+ * @return a pointer to the new map or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the map
+ */
+gmap *gmap_create_counter(size_t (*size)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *))
+{
+    gmap* m = gmap_create_bytes(size, comp, h);
+    if (m == NULL)
+        return NULL;
+
+    // slots move when the table is rehashed, so counts live in a slab
+    m->counts = slab_create(sizeof(int64_t));
+    if (m->counts == NULL)
+    {
+        gmap_destroy(m);
+        return NULL;
+    }
+    return m;
+}
+
+
+/**
+ * Returns the number of (key, value) pairs in the given map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @return the size of the map pointed to by m
+ */
+size_t gmap_size(const gmap *m)
+{
+    if (m == NULL)
+        return 0;
+    return m->nkey;
+}
+
+
+/**
+ * Adds a copy of the given key with value to this map.  If the key is
+ * already present then the old value is replaced and returned.  The
+ * map copies the key, so the caller retains ownership of the original
+ * key and may modify it or destroy it without affecting the map.  The
+ * map copies the pointer to the value, but the caller retains
+ * ownership of the value.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param value a pointer to a value
+ * @return a pointer to the old value, or NULL, or a pointer to gmap_error
+ */
+void *gmap_put(gmap *m, const void *key, void *value)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+    if (m->counts != NULL)
+        return gmap_error;
+
+    bool added;
+    size_t index = gmap_flat_find_or_add(m, key, &added);
+    if (index == m->cap)
+        return gmap_error;
+
+    // update value in place
+    void* oldvalue = added ? NULL : m->slots[index].value;
+    m->slots[index].value = value;
+    return oldvalue;
+}
+
+/**
+ * Removes the given key and its associated value from the given map if
+ * the key is present.  The return value is NULL and there is no effect
+ * on the map if the key is not present.  The copy of the key held by
+ * the map is destroyed.  It is the caller's responsibility to free the
+ * returned value if necessary.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a key, non-NULL
+ * @return the value associated with the removed key, or NULL
+ */
+void *gmap_remove(gmap *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    size_t index = gmap_flat_find(m, key, gmap_flat_hash(m, key), NULL);
+    if (index == m->cap)
+        return NULL;
+
+    // a counter map's counts belong to the map
+    void* result = m->counts == NULL ? m->slots[index].value : NULL;
+    if (m->counts != NULL)
+        slab_free(m->counts, m->slots[index].value);
+    gmap_free_key(m, m->slots[index].key);
+    m->slots[index].key = NULL;
+    m->slots[index].value = NULL;
+
+    // probes stop at the first group with an EMPTY byte, so if this group
+    // already has one then no probe can have passed through it
+    const uint8_t* group = m->ctrl + (index & ~(size_t)(GROUP_WIDTH - 1));
+    if (group_match(group, CTRL_EMPTY) != 0)
+    {
+        m->ctrl[index] = CTRL_EMPTY;
+    }
+    else
+    {
+        m->ctrl[index] = CTRL_DELETED;
+        m->ndeleted++;
+    }
+    m->nkey--;
+    return result;
+}
+
+
+/**
+ * Determines if the given key is present in this map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return true if a key equal to the one pointed to is present in this map,
+ * false otherwise
+ */
+bool gmap_contains_key(const gmap *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return false;
+
+    return gmap_flat_find(m, key, gmap_flat_hash(m, key), NULL) != m->cap;
+}
+
+
+/**
+ * Returns the value associated with the given key in this map.
+ * If the key is not present in this map then the returned value is
+ * NULL.  The pointer returned is the original pointer passed to gmap_put,
+ * and it remains the responsibility of whatever called gmap_put to
+ * release the value it points to (no ownership transfer results from
+ * gmap_get).
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the assocated value, or NULL if they key is not present
+ */
+void *gmap_get(gmap *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    size_t index = gmap_flat_find(m, key, gmap_flat_hash(m, key), NULL);
+    if (index == m->cap)
+        return NULL;
+    return m->slots[index].value;
+}
+
+
+/**
+ * Calls the given function for each (key, value) pair in this map, passing
+ * the extra argument as well.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param f a pointer to a function that takes a key, a value, and an
+ * extra piece of information, and does not add or remove keys from the
+ * map, non-NULL
+ * @param arg a pointer
+ */
+void gmap_for_each(gmap *m, void (*f)(const void *, void *, void *), void *arg)
+{
+    if (m == NULL || f == NULL)
+        return;
+
+    for (size_t i = 0; i < m->cap; i++)
+    {
+        if (!(m->ctrl[i] & 0x80))
+            f(m->slots[i].key, m->slots[i].value, arg);
+    }
+}
+
+
+/**
+ * Calls the given function for each (key, value) pair in this map, as for
+ * gmap_for_each.  This backend is built without threads, so every pair is
+ * visited by the calling thread with args[0].
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param f a pointer to a function that takes a key, a value, and an
+ * extra piece of information, and does not change the map, non-NULL
+ * @param args a pointer to an array of nthreads pointers
+ * @param nthreads the most threads to use, counting the calling thread
+ */
+void gmap_for_each_parallel(gmap *m, void (*f)(const void *, void *, void *), void **args, size_t nthreads)
+{
+    if (m == NULL || args == NULL || nthreads == 0)
+        return;
+
+    gmap_for_each(m, f, args[0]);
+}
+
+
+/**
+ * Returns an array containing pointers to all of the keys in the
+ * given map.  The return value is NULL if there was an error
+ * allocating the array.  The map retains ownership of the keys, and
+ * the pointers to them are only valid as long until they are removed
+ * from the map, or until the map is destroyed, whichever comes first.
+ * It is the caller's responsibility to destroy the returned array if
+ * it is non-NULL.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @return a pointer to an array of pointers to the keys, or NULL
+ */
+const void **gmap_keys(gmap *m)
+{
+    if (m == NULL) return NULL;
+
+    const void **keys = malloc(sizeof(*keys) * m->nkey);
+    if (keys != NULL)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < m->cap; i++)
+        {
+            if (!(m->ctrl[i] & 0x80))
+                keys[n++] = m->slots[i].key;
+        }
+    }
+    return keys;
+}
+
+/**
+ * Destroys the given map.  There is no effect if the given pointer is NULL.
+ *
+ * @param m a pointer to a map, or NULL
+ */
+void gmap_destroy(gmap *m)
+{
+    if (m != NULL)
+    {
+        // keys only need visiting if some were not carved from the slabs
+        for (size_t i = 0; (m->sizer == NULL || m->nbigkeys > 0) && i < m->cap; i++)
+        {
+            if (!(m->ctrl[i] & 0x80))
+                gmap_free_key(m, m->slots[i].key);
+        }
+        for (int c = 0; c < GMAP_KEY_CLASSES; c++)
+            slab_destroy(m->keys[c]);
+        slab_destroy(m->counts);
+        free(m->ctrl);
+        free(m->slots);
+        free(m);
+    }
+}
+
+/**
+ * Chooses whether this map resizes all at once or incrementally.  In
+ * incremental mode the old and new tables coexist after a resize and each
+ * later put, get, and remove moves a bounded amount of old entries, so no
+ * single operation pays for rehashing the whole map.  Turning the mode off
+ * finishes any resize in progress.  Backends that cannot resize
+ * incrementally always resize all at once and say so by returning false
+ * when asked for incremental mode.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param incremental true for incremental resizing, false for all at once
+ * @return true if the map now resizes as asked, false otherwise
+ */
+bool gmap_set_incremental_resize(gmap *m, bool incremental)
+{
+    // the flat table always rehashes in one step; the slot array is
+    // contiguous so a rehash is a single sequential pass
+    return m != NULL && !incremental;
+}
+
+/**
+ * Chooses whether this map keeps a Bloom filter of its keys' hash codes.
+ * With the filter, most searches for keys that are not present (by get,
+ * contains_key, lookup and remove) are answered from one cache line of
+ * the filter without walking a chain or calling the compare function.
+ * The filter takes about two bytes per bucket; it is updated by every put
+ * and rebuilt whenever the table is resized.  Removed keys stay in the
+ * filter until the next rebuild, so removals leave it less selective but
+ * never wrong.  Searches for keys that are present read the filter too,
+ * so it pays off when many searches miss.  Backends whose misses are
+ * already cheap ignore this setting.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param enabled true to keep a filter, false to discard it
+ * @return true if successful, false if the filter could not be allocated
+ */
+bool gmap_set_miss_filter(gmap *m, bool enabled)
+{
+    // a miss already stops at the first group of control bytes with an
+    // empty slot, and tags rule out almost every comparison before that
+    return m != NULL;
+}
+
+/**
+ * Makes room for at least n pairs in this map, so that putting them does
+ * not resize it again.  Any incremental resize in progress is finished
+ * first.  The map is unchanged if the larger table cannot be allocated.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param n the number of pairs to make room for
+ * @return true if successful, false if there was an allocation error
+ */
+bool gmap_reserve(gmap *m, size_t n)
+{
+    if (m == NULL)
+        return false;
+
+    size_t newcap = gmap_flat_capacity(n);
+    return newcap <= m->cap || gmap_flat_rehash(m, newcap);
+}
+
+/**
+ * Shrinks this map's table to the smallest capacity that holds its
+ * current pairs (but not below the initial capacity) and moves its
+ * entries into freshly allocated memory so that space left behind by
+ * removals is returned.  Pointers to keys obtained from the map become
+ * invalid for maps made by gmap_create_bytes.  The map is unchanged if
+ * the new memory cannot be allocated.
+ *
+ * @param m a pointer to a map, non-NULL
+ */
+void gmap_shrink_to_fit(gmap *m)
+{
+    if (m == NULL)
+        return;
+
+    // slabs never give blocks back while in use, so copy short keys into new ones
+    slab* newkeys[GMAP_KEY_CLASSES] = {NULL};
+    bool ok = true;
+    for (int c = 0; m->sizer != NULL && c < GMAP_KEY_CLASSES; c++)
+    {
+        newkeys[c] = slab_create(GMAP_MIN_KEY_CLASS << c);
+        ok = ok && newkeys[c] != NULL;
+    }
+
+    size_t oldcap = m->cap;
+    size_t oldndeleted = m->ndeleted;
+    uint8_t* oldctrl = m->ctrl;
+    slot* oldslots = m->slots;
+    ok = ok && gmap_flat_alloc(m, gmap_flat_capacity(m->nkey));
+
+    for (size_t i = 0; ok && i < oldcap; i++)
+    {
+        if (!(oldctrl[i] & 0x80))
+        {
+            slot entry = oldslots[i];
+            int c = m->sizer != NULL ? gmap_key_class(m->sizer(entry.key)) : -1;
+            if (c >= 0)
+            {
+                entry.key = slab_alloc(newkeys[c]);
+                ok = entry.key != NULL;
+                if (ok)
+                    memcpy(entry.key, oldslots[i].key, m->sizer(oldslots[i].key));
+            }
+            size_t index = gmap_flat_find_free(m, entry.hash);
+            m->ctrl[index] = HASH_TAG(entry.hash);
+            m->slots[index] = entry;
+        }
+    }
+
+    if (!ok)
+    {
+        // put back the old table if the new one was installed
+        if (m->ctrl != oldctrl)
+        {
+            free(m->ctrl);
+            free(m->slots);
+            m->ctrl = oldctrl;
+            m->slots = oldslots;
+            m->cap = oldcap;
+            m->ndeleted = oldndeleted;
+        }
+        for (int c = 0; c < GMAP_KEY_CLASSES; c++)
+            slab_destroy(newkeys[c]);
+        return;
+    }
+
+    free(oldctrl);
+    free(oldslots);
+    for (int c = 0; c < GMAP_KEY_CLASSES; c++)
+    {
+        slab_destroy(m->keys[c]);
+        m->keys[c] = newkeys[c];
+    }
+}
+
+/**
+ * Adds copies of the given keys with their values to this empty map,
+ * spreading the work over up to nthreads threads.  The result is the same
+ * as putting the pairs one at a time in order, so a later pair replaces
+ * the value of an earlier one with an equal key.  The map's hash, compare
+ * and copy functions are called from several threads at once and must be
+ * safe to call that way.  Backends that cannot build in parallel, and
+ * inputs too small to be worth the threads, put the pairs one at a time.
+ *
+ * @param m a pointer to an empty map, non-NULL
+ * @param pairs a pointer to an array of n pairs with non-NULL keys
+ * @param n the number of pairs
+ * @param nthreads the most threads to use, counting the calling thread
+ * @return true if successful, false if m was not empty or there was an
+ * allocation error, in which case m holds some of the pairs
+ */
+bool gmap_build_parallel(gmap *m, const gmap_pair *pairs, size_t n, size_t nthreads)
+{
+    // probe runs cross any split of the slots, so this backend builds serially
+    (void)nthreads;
+    if (m == NULL || m->nkey != 0 || m->counts != NULL || !gmap_reserve(m, n))
+        return false;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (gmap_put(m, pairs[i].key, pairs[i].value) == gmap_error)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Fills in the given statistics for the given map.  This visits every
+ * entry, so it takes time proportional to the size of the map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param stats a pointer to the statistics to fill in, non-NULL
+ */
+void gmap_get_stats(const gmap *m, gmap_stats *stats)
+{
+    if (m == NULL || stats == NULL)
+        return;
+
+#ifdef GMAP_STATS
+    *stats = m->stats;
+#else
+    *stats = (gmap_stats){0};
+#endif
+    stats->size = m->nkey;
+    stats->buckets = m->cap;
+    stats->load_factor = (double)m->nkey / m->cap;
+
+    size_t group_mask = m->cap / GROUP_WIDTH - 1;
+    for (size_t i = 0; i < m->cap; i++)
+    {
+        if (m->ctrl[i] & 0x80)
+            continue;
+
+        // replay the probe sequence from the key's home group to its slot
+        size_t g = HASH_GROUP(m->slots[i].hash) & group_mask;
+        size_t probes = 1;
+        while (g != i / GROUP_WIDTH)
+        {
+            g = (g + probes) & group_mask;
+            probes++;
+        }
+        stats->histogram[probes < GMAP_STATS_HISTOGRAM ? probes : GMAP_STATS_HISTOGRAM - 1]++;
+        if (probes > stats->longest)
+            stats->longest = probes;
+
+        if (m->sizer != NULL && gmap_key_class(m->sizer(m->slots[i].key)) < 0)
+            stats->key_bytes += m->sizer(m->slots[i].key);
+    }
+
+    // the control bytes index the slots, which hold the entries themselves
+    stats->table_bytes = m->cap;
+    stats->node_bytes = m->cap * sizeof(slot) + slab_bytes(m->counts);
+    for (int c = 0; c < GMAP_KEY_CLASSES; c++)
+        stats->key_bytes += slab_bytes(m->keys[c]);
+}
+
+/**
+ * Returns the value associated with the given key, first adding a copy
+ * of the key with the given value if it is not present.  The key is
+ * hashed once and the table is probed once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param value a pointer to the value to add if key is not present
+ * @return the existing value, or value if it was added, or a pointer to gmap_error
+ */
+void *gmap_get_or_put(gmap *m, const void *key, void *value)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+    if (m->counts != NULL)
+        return gmap_error;
+
+    bool added;
+    size_t index = gmap_flat_find_or_add(m, key, &added);
+    if (index == m->cap)
+        return gmap_error;
+
+    if (added)
+        m->slots[index].value = value;
+    return m->slots[index].value;
+}
+
+
+/**
+ * Replaces the value associated with the given key by the result of
+ * calling update on the current value, adding a copy of the key first
+ * if it is not present.  The key is hashed once and the table is probed
+ * once.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param update a pointer to a function that takes the current value (NULL
+ * if the key was not present), whether the key was present, and the extra
+ * argument, and returns the new value, non-NULL
+ * @param arg a pointer passed to update
+ * @return the new value, or a pointer to gmap_error
+ */
+void *gmap_upsert(gmap *m, const void *key, void *(*update)(void *, bool, void *), void *arg)
+{
+    if (m == NULL || key == NULL || update == NULL)
+        return NULL;
+    if (m->counts != NULL)
+        return gmap_error;
+
+    bool added;
+    size_t index = gmap_flat_find_or_add(m, key, &added);
+    if (index == m->cap)
+        return gmap_error;
+
+    m->slots[index].value = update(m->slots[index].value, !added, arg);
+    return m->slots[index].value;
+}
+
+
+/**
+ * Adds delta to the count of the given key in a map made by
+ * gmap_create_counter, first adding a copy of the key with a count of 0
+ * if it is not present.  The key is hashed once and the table is probed
+ * once.
+ *
+ * @param m a pointer to a map made by gmap_create_counter, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param delta the amount to add
+ * @return a pointer to the key's new count, or NULL if there was an
+ * allocation error or m is not a counting map
+ */
+int64_t *gmap_increment(gmap *m, const void *key, int64_t delta)
+{
+    if (m == NULL || key == NULL || m->counts == NULL)
+        return NULL;
+
+    bool added;
+    size_t index = gmap_flat_find_or_add(m, key, &added);
+    if (index == m->cap)
+        return NULL;
+
+    if (added)
+    {
+        int64_t* count = slab_alloc(m->counts);
+        if (count == NULL)
+        {
+            gmap_remove(m, key);
+            return NULL;
+        }
+        *count = 0;
+        m->slots[index].value = count;
+    }
+
+    int64_t* count = m->slots[index].value;
+    *count += delta;
+    return count;
+}
+
+
+/**
+ * Returns a handle to the value associated with the given key, or NULL if
+ * the key is not present.  The value can be read and replaced through the
+ * handle without another lookup.  The handle is valid until the next put,
+ * remove, or other change to the map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the stored value pointer, or NULL
+ */
+void **gmap_lookup(gmap *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    size_t index = gmap_flat_find(m, key, gmap_flat_hash(m, key), NULL);
+    return index == m->cap ? NULL : &m->slots[index].value;
+}
+
+/**
+ * Returns the number of buckets in the given map, which for this table is
+ * the number of slots.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @return the number of buckets in the map
+ */
+size_t gmap_bucket_count(const gmap *m)
+{
+    if (m == NULL)
+        return 0;
+    return m->cap;
+}
+
+
+/**
+ * Starts a cursor over every (key, value) pair in the given map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param it a pointer to a cursor to initialize, non-NULL
+ */
+void gmap_iter_begin(gmap *m, gmap_iter *it)
+{
+    gmap_iter_range(m, it, 0, gmap_bucket_count(m));
+}
+
+
+/**
+ * Starts a cursor over the (key, value) pairs in slots from (inclusive)
+ * to to (exclusive) of the given map.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param it a pointer to a cursor to initialize, non-NULL
+ * @param from the first bucket to visit
+ * @param to one past the last bucket to visit, at most gmap_bucket_count(m)
+ */
+void gmap_iter_range(gmap *m, gmap_iter *it, size_t from, size_t to)
+{
+    it->m = m;
+    it->bucket = from;
+    it->end = to;
+    it->pos = NULL;
+}
+
+
+/**
+ * Advances the given cursor, storing the next key and value through key
+ * and value if they are non-NULL.
+ *
+ * @param it a pointer to a cursor started by gmap_iter_begin or gmap_iter_range
+ * @param key a pointer to where to store a pointer to the key, or NULL
+ * @param value a pointer to where to store the value pointer, or NULL
+ * @return true if a pair was found, false if the cursor is finished
+ */
+bool gmap_iter_next(gmap_iter *it, const void **key, void **value)
+{
+    const gmap* m = it->m;
+    if (m == NULL)
+        return false;
+
+    while (it->bucket < it->end)
+    {
+        size_t i = it->bucket++;
+        if (!(m->ctrl[i] & 0x80))
+        {
+            if (key != NULL) *key = m->slots[i].key;
+            if (value != NULL) *value = m->slots[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+
+/**
+ * Returns the user's hash of key passed through a 64-bit finalizer, so that
+ * both the tag (low bits) and the starting group (high bits) are usable
+ * even for weak hash functions.
+ */
+static size_t gmap_flat_hash(const gmap* m, const void* key)
+{
+    uint64_t h = (uint64_t)m->hasher(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+/**
+ * Returns the index of the slot holding key, or m->cap if it is not present.
+ * Groups are visited in triangular order, which covers every group when
+ * the number of groups is a power of two.  If free_index is non-NULL and
+ * the key is not present, it is set to the first EMPTY or DELETED slot
+ * passed, which is where the key would be added.
+ */
+static size_t gmap_flat_find(const gmap* m, const void* key, size_t hash, size_t* free_index)
+{
+    size_t group_mask = m->cap / GROUP_WIDTH - 1;
+    size_t g = HASH_GROUP(hash) & group_mask;
+    uint8_t tag = HASH_TAG(hash);
+    if (free_index != NULL)
+        *free_index = m->cap;
+
+    for (size_t step = 1; step <= group_mask + 1; step++)
+    {
+        const uint8_t* group = m->ctrl + g * GROUP_WIDTH;
+        unsigned match = group_match(group, tag);
+        while (match != 0)
+        {
+            size_t index = g * GROUP_WIDTH + LOWEST_BIT(match);
+            if (m->slots[index].hash == hash && m->comparer(key, m->slots[index].key) == 0)
+            {
+                GMAP_COUNT_SEARCH(m, true, step);
+                return index;
+            }
+            match &= match - 1;
+        }
+        if (free_index != NULL && *free_index == m->cap)
+        {
+            unsigned free_match = group_match_free(group);
+            if (free_match != 0)
+                *free_index = g * GROUP_WIDTH + LOWEST_BIT(free_match);
+        }
+        if (group_match(group, CTRL_EMPTY) != 0)
+        {
+            GMAP_COUNT_SEARCH(m, false, step);
+            return m->cap;
+        }
+        g = (g + step) & group_mask;
+    }
+    GMAP_COUNT_SEARCH(m, false, group_mask + 1);
+    return m->cap;
+}
+
+/**
+ * Returns the index of the slot for key, adding a copy of the key with a
+ * NULL value if it is not present, or m->cap if there was an allocation
+ * error.  Sets *added to whether a slot was filled.  The probe that finds
+ * the key also finds its free slot, unless the table has to be rehashed.
+ */
+static size_t gmap_flat_find_or_add(gmap* m, const void* key, bool* added)
+{
+    size_t hash = gmap_flat_hash(m, key);
+    size_t index;
+    size_t found = gmap_flat_find(m, key, hash, &index);
+    if (found != m->cap)
+    {
+        *added = false;
+        return found;
+    }
+
+    // keep at least 1/8 of the slots EMPTY so probes terminate quickly
+    if ((m->nkey + m->ndeleted + 1) * 8 > m->cap * 7)
+    {
+        // grow if mostly live, otherwise just clear out the tombstones
+        size_t newcap = (m->nkey + 1) * 16 > m->cap * 7 ? m->cap * 2 : m->cap;
+        if (!gmap_flat_rehash(m, newcap))
+            return m->cap;
+        index = gmap_flat_find_free(m, hash);
+    }
+
+    void* keycopy = gmap_copy_key(m, key);
+    if (keycopy == NULL)
+        return m->cap;
+
+    if (m->ctrl[index] == CTRL_DELETED)
+        m->ndeleted--;
+    m->ctrl[index] = HASH_TAG(hash);
+    m->slots[index].key = keycopy;
+    m->slots[index].value = NULL;
+    m->slots[index].hash = hash;
+    m->nkey++;
+    *added = true;
+    return index;
+}
+
+/**
+ * Returns the index of the first EMPTY or DELETED slot on the probe
+ * sequence for hash.  There must be at least one such slot.
+ */
+static size_t gmap_flat_find_free(const gmap* m, size_t hash)
+{
+    size_t group_mask = m->cap / GROUP_WIDTH - 1;
+    size_t g = HASH_GROUP(hash) & group_mask;
+
+    for (size_t step = 1; ; step++)
+    {
+        unsigned match = group_match_free(m->ctrl + g * GROUP_WIDTH);
+        if (match != 0)
+            return g * GROUP_WIDTH + LOWEST_BIT(match);
+        g = (g + step) & group_mask;
+    }
+}
+
+/*
+ * Allocate an empty table of the given capacity into m.  The map is left
+ * unchanged if allocation fails.
+ */
+static bool gmap_flat_alloc(gmap* m, size_t cap)
+{
+    uint8_t* ctrl = malloc(cap);
+    slot* slots = malloc(cap * sizeof(slot));
+    if (ctrl == NULL || slots == NULL)
+    {
+        free(ctrl);
+        free(slots);
+        return false;
+    }
+    memset(ctrl, CTRL_EMPTY, cap);
+    m->ctrl = ctrl;
+    m->slots = slots;
+    m->cap = cap;
+    m->ndeleted = 0;
+    return true;
+}
+
+/*
+ * Move every entry into a fresh table of the given capacity, dropping
+ * tombstones.
+ */
+static bool gmap_flat_rehash(gmap* m, size_t newcap)
+{
+    uint8_t* oldctrl = m->ctrl;
+    slot* oldslots = m->slots;
+    size_t oldcap = m->cap;
+
+    if (!gmap_flat_alloc(m, newcap))
+        return false;
+    GMAP_COUNT_RESIZE(m);
+    GMAP_TIMER_START(start);
+
+    for (size_t i = 0; i < oldcap; i++)
+    {
+        if (!(oldctrl[i] & 0x80))
+        {
+            size_t hash = oldslots[i].hash;
+            size_t index = gmap_flat_find_free(m, hash);
+            m->ctrl[index] = HASH_TAG(hash);
+            m->slots[index] = oldslots[i];
+        }
+    }
+
+    free(oldctrl);
+    free(oldslots);
+    GMAP_TIMER_STOP(m, start);
+    return true;
+}
+
+/*
+ * Returns the smallest table capacity that holds n pairs without growing.
+ */
+static size_t gmap_flat_capacity(size_t n)
+{
+    size_t cap = GMAP_INITIAL_CAPACITY;
+    while (n * 8 > cap * 7)
+        cap *= 2;
+    return cap;
+}
+
+/*
+ * Create a map with the given key functions.  Exactly one of cp (with f)
+ * or size is non-NULL.
+ */
+static gmap* gmap_flat_create(void *(*cp)(const void *), int (*comp)(const void *, const void *), size_t (*h)(const void *), void (*f)(void *), size_t (*size)(const void *))
+{
+    struct _gmap* newmap = calloc(1, sizeof(*newmap));
+    if (newmap == NULL)
+        return NULL;
+
+    newmap->copier = cp;
+    newmap->comparer = comp;
+    newmap->hasher = h;
+    newmap->freer = f;
+    newmap->sizer = size;
+
+    bool ok = gmap_flat_alloc(newmap, GMAP_INITIAL_CAPACITY);
+    for (int c = 0; size != NULL && c < GMAP_KEY_CLASSES; c++)
+    {
+        newmap->keys[c] = slab_create(GMAP_MIN_KEY_CLASS << c);
+        ok = ok && newmap->keys[c] != NULL;
+    }
+
+    if (!ok)
+    {
+        free(newmap->ctrl);
+        free(newmap->slots);
+        for (int c = 0; c < GMAP_KEY_CLASSES; c++)
+            slab_destroy(newmap->keys[c]);
+        free(newmap);
+        return NULL;
+    }
+    return newmap;
+}
+
+/*
+ * Returns the slab size class for a key of the given number of bytes,
+ * or -1 if it is too long for every class.
+ */
+static int gmap_key_class(size_t size)
+{
+    for (int c = 0; c < GMAP_KEY_CLASSES; c++)
+    {
+        if (size <= ((size_t)GMAP_MIN_KEY_CLASS << c))
+            return c;
+    }
+    return -1;
+}
+
+/*
+ * Make the map's own copy of key, or return NULL on allocation failure
+ */
+static void* gmap_copy_key(gmap* m, const void* key)
+{
+    if (m->sizer == NULL)
+        return m->copier(key);
+
+    size_t size = m->sizer(key);
+    int c = gmap_key_class(size);
+    void* copy = c >= 0 ? slab_alloc(m->keys[c]) : malloc(size);
+    if (copy != NULL)
+    {
+        memcpy(copy, key, size);
+        if (c < 0) m->nbigkeys++;
+    }
+    return copy;
+}
+
+/*
+ * Release a key copy made by gmap_copy_key
+ */
+static void gmap_free_key(gmap* m, void* key)
+{
+    if (m->sizer == NULL)
+    {
+        m->freer(key);
+        return;
+    }
+
+    int c = gmap_key_class(m->sizer(key));
+    if (c >= 0)
+        slab_free(m->keys[c], key);
+    else
+    {
+        free(key);
+        m->nbigkeys--;
+    }
+}
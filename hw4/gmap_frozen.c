@@ -0,0 +1,358 @@
+/* CPSC223 Fall 2022 hw4
+ * Read-only maps indexed by a minimal perfect hash function, built with
+ * the CHD (hash, displace, and compress) algorithm.
+ */
+
+#include "gmap_frozen.h"
+#include <string.h>
+#include <stdint.h>
+
+// average number of keys per displacement bucket
+#define GMAP_FROZEN_BUCKET_KEYS 4
+
+// first displacements tried for a bucket of two or more keys
+#define GMAP_FROZEN_MAX_D0 64
+
+// seeds tried before giving up
+#define GMAP_FROZEN_TRIES 16
+
+/*
+ * Each key is hashed to a bucket and to two values f1 and f2.  Bucket b's
+ * displacement (d0, d1) sends each of its keys to slot
+ * (f1 + d0 * f2 + d1) % n, and is chosen so no two keys share a slot.
+ */
+typedef struct _gmap_frozen_displacement
+{
+    uint32_t d0;
+    uint32_t d1;
+} gmap_frozen_displacement;
+
+// a slot's key and value, side by side so a hit reads one line
+typedef struct _gmap_frozen_pair
+{
+    const void* key;
+    void* value;
+} gmap_frozen_pair;
+
+struct _gmap_frozen
+{
+    // number of keys, which is also the number of slots
+    size_t n;
+    size_t nbuckets;
+    gmap_frozen_displacement* displacements;
+    gmap_frozen_pair* pairs;
+    uint64_t seed;
+    int (*comparer)(const void *, const void *);
+    size_t (*hasher)(const void *);
+};
+
+// helper function declarations
+static uint64_t gmap_frozen_mix(uint64_t x);
+static size_t gmap_frozen_slot(const gmap_frozen* f, uint64_t hash);
+static bool gmap_frozen_build(gmap_frozen* f, const uint64_t* hashes, size_t* order, size_t* slot_of);
+static bool gmap_frozen_distinct(const uint64_t* hashes, size_t n);
+static int gmap_frozen_compare_hashes(const void* a, const void* b);
+
+/**
+ * Builds a frozen map over the pairs now in the given map.  The frozen
+ * map refers to m's copies of the keys, so m must not have pairs removed
+ * and must not be destroyed while the frozen map is in use; values are
+ * recorded as they are now.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param comp the compare function m was created with
+ * @param h the hash function m was created with
+ * @return a pointer to the frozen map, or NULL if there was an allocation
+ * error or two keys in m have the same hash code; it is the caller's
+ * responsibility to destroy the frozen map
+ */
+gmap_frozen *gmap_freeze(gmap *m, int (*comp)(const void *, const void *), size_t (*h)(const void *))
+{
+    if (m == NULL || comp == NULL || h == NULL)
+        return NULL;
+
+    gmap_frozen* f = calloc(1, sizeof(gmap_frozen));
+    if (f == NULL)
+        return NULL;
+    f->n = gmap_size(m);
+    f->nbuckets = f->n / GMAP_FROZEN_BUCKET_KEYS + 1;
+    f->comparer = comp;
+    f->hasher = h;
+
+    // room for one slot even when empty, so lookups need no special case
+    size_t nslots = f->n > 0 ? f->n : 1;
+    const void** keys = malloc(nslots * sizeof(void*));
+    void** values = malloc(nslots * sizeof(void*));
+    uint64_t* hashes = malloc(nslots * sizeof(uint64_t));
+    size_t* order = malloc(nslots * sizeof(size_t));
+    size_t* slot_of = malloc(nslots * sizeof(size_t));
+    f->pairs = calloc(nslots, sizeof(gmap_frozen_pair));
+    f->displacements = malloc(f->nbuckets * sizeof(gmap_frozen_displacement));
+    bool ok = keys != NULL && values != NULL && hashes != NULL && order != NULL && slot_of != NULL
+        && f->pairs != NULL && f->displacements != NULL;
+
+    if (ok)
+    {
+        gmap_iter it;
+        gmap_iter_begin(m, &it);
+        for (size_t i = 0; gmap_iter_next(&it, keys + i, values + i); i++)
+            hashes[i] = h(keys[i]);
+        // keys with equal hash codes can never be sent to different slots
+        ok = gmap_frozen_distinct(hashes, f->n) && gmap_frozen_build(f, hashes, order, slot_of);
+    }
+
+    for (size_t i = 0; ok && i < f->n; i++)
+    {
+        f->pairs[slot_of[i]].key = keys[i];
+        f->pairs[slot_of[i]].value = values[i];
+    }
+
+    free(keys);
+    free(values);
+    free(hashes);
+    free(order);
+    free(slot_of);
+    if (!ok)
+    {
+        gmap_frozen_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+/**
+ * Returns the number of (key, value) pairs in the given frozen map.
+ *
+ * @param f a pointer to a frozen map, non-NULL
+ * @return the size of the frozen map pointed to by f
+ */
+size_t gmap_frozen_size(const gmap_frozen *f)
+{
+    if (f == NULL)
+        return 0;
+
+    return f->n;
+}
+
+/**
+ * Determines if the given key is present in this frozen map.
+ *
+ * @param f a pointer to a frozen map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return true if a key equal to the one pointed to is present, false otherwise
+ */
+bool gmap_frozen_contains_key(const gmap_frozen *f, const void *key)
+{
+    if (f == NULL || key == NULL || f->n == 0)
+        return false;
+
+    const gmap_frozen_pair* p = f->pairs + gmap_frozen_slot(f, f->hasher(key));
+    return f->comparer(key, p->key) == 0;
+}
+
+/**
+ * Returns the value associated with the given key in this frozen map, or
+ * NULL if the key is not present.
+ *
+ * @param f a pointer to a frozen map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the associated value, or NULL if the key is not present
+ */
+void *gmap_frozen_get(const gmap_frozen *f, const void *key)
+{
+    if (f == NULL || key == NULL || f->n == 0)
+        return NULL;
+
+    // the only slot the key can be in
+    const gmap_frozen_pair* p = f->pairs + gmap_frozen_slot(f, f->hasher(key));
+    return f->comparer(key, p->key) == 0 ? p->value : NULL;
+}
+
+/**
+ * Destroys the given frozen map.  The map it was built from is not
+ * affected.  There is no effect if the given pointer is NULL.
+ *
+ * @param f a pointer to a frozen map, or NULL
+ */
+void gmap_frozen_destroy(gmap_frozen *f)
+{
+    if (f != NULL)
+    {
+        free(f->displacements);
+        free(f->pairs);
+        free(f);
+    }
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+/*
+ * The 64-bit finalizer from MurmurHash3; spreads every input bit over the
+ * whole output.
+ */
+static uint64_t gmap_frozen_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+ * Bucket and slot position helpers; all three are derived from the key's
+ * hash code and the seed, so hashing the key once is enough.
+ */
+#define GMAP_FROZEN_BUCKET(f, hash) (gmap_frozen_mix((hash) ^ (f)->seed) % (f)->nbuckets)
+#define GMAP_FROZEN_F1(f, hash) (gmap_frozen_mix((hash) + (f)->seed * 3 + 1) % (f)->n)
+#define GMAP_FROZEN_F2(f, hash) (gmap_frozen_mix((hash) + (f)->seed * 5 + 2) % (f)->n)
+
+/*
+ * Returns the slot for a key with the given hash code.
+ */
+static size_t gmap_frozen_slot(const gmap_frozen* f, uint64_t hash)
+{
+    gmap_frozen_displacement d = f->displacements[GMAP_FROZEN_BUCKET(f, hash)];
+    return (GMAP_FROZEN_F1(f, hash) + d.d0 * GMAP_FROZEN_F2(f, hash) + d.d1) % f->n;
+}
+
+/*
+ * Choose a seed and displacements for the keys with the given hash codes,
+ * and set slot_of[i] to the slot of key i.  order is scratch space for n
+ * key indices.  Returns false if no seed worked or there was an allocation
+ * error.
+ */
+static bool gmap_frozen_build(gmap_frozen* f, const uint64_t* hashes, size_t* order, size_t* slot_of)
+{
+    size_t n = f->n;
+    size_t nbuckets = f->nbuckets;
+    size_t* starts = malloc((nbuckets + 1) * sizeof(size_t));
+    size_t* by_size = malloc(nbuckets * sizeof(size_t));
+    size_t* size_count = malloc((n + 2) * sizeof(size_t));
+    unsigned char* taken = malloc(n > 0 ? n : 1);
+    size_t* base = malloc((n > 0 ? n : 1) * sizeof(size_t));
+    bool ok = starts != NULL && by_size != NULL && size_count != NULL && taken != NULL && base != NULL;
+
+    bool built = false;
+    for (int attempt = 0; ok && !built && attempt < GMAP_FROZEN_TRIES; attempt++)
+    {
+        f->seed = gmap_frozen_mix(0x9E3779B97F4A7C15ULL * (attempt + 1));
+        memset(f->displacements, 0, nbuckets * sizeof(gmap_frozen_displacement));
+        memset(taken, 0, n > 0 ? n : 1);
+
+        // group the keys by bucket
+        memset(starts, 0, (nbuckets + 1) * sizeof(size_t));
+        for (size_t i = 0; i < n; i++)
+            starts[GMAP_FROZEN_BUCKET(f, hashes[i]) + 1]++;
+        for (size_t b = 0; b < nbuckets; b++)
+            starts[b + 1] += starts[b];
+        for (size_t i = 0; i < n; i++)
+            slot_of[i] = starts[GMAP_FROZEN_BUCKET(f, hashes[i])]++;
+        for (size_t i = 0; i < n; i++)
+            order[slot_of[i]] = i;
+        for (size_t b = nbuckets; b > 0; b--)
+            starts[b] = starts[b - 1];
+        starts[0] = 0;
+
+        // biggest buckets first, while the table is emptiest
+        memset(size_count, 0, (n + 2) * sizeof(size_t));
+        for (size_t b = 0; b < nbuckets; b++)
+            size_count[starts[b + 1] - starts[b]]++;
+        for (size_t s = n + 1; s > 0; s--)
+            size_count[s - 1] += size_count[s];
+        for (size_t b = 0; b < nbuckets; b++)
+            by_size[--size_count[starts[b + 1] - starts[b]]] = b;
+
+        bool placed = true;
+        size_t next_free = 0;
+        for (size_t k = 0; placed && k < nbuckets; k++)
+        {
+            size_t b = by_size[k];
+            size_t first = starts[b];
+            size_t count = starts[b + 1] - first;
+            if (count == 0)
+                break;
+
+            if (count == 1)
+            {
+                // any free slot will do: pick d1 to land on it
+                while (taken[next_free])
+                    next_free++;
+                size_t i = order[first];
+                f->displacements[b].d1 = (uint32_t)((next_free + n - GMAP_FROZEN_F1(f, hashes[i])) % n);
+                taken[next_free] = 1;
+                slot_of[i] = next_free;
+                continue;
+            }
+
+            // try displacements until every key of the bucket lands in a different free slot
+            placed = false;
+            for (uint32_t d0 = 0; !placed && d0 < GMAP_FROZEN_MAX_D0; d0++)
+            {
+                // each key's slot for d1 = 0; larger d1 just shift them along
+                for (size_t j = 0; j < count; j++)
+                {
+                    uint64_t hash = hashes[order[first + j]];
+                    base[j] = (GMAP_FROZEN_F1(f, hash) + d0 * GMAP_FROZEN_F2(f, hash)) % n;
+                }
+                for (size_t d1 = 0; !placed && d1 < n; d1++)
+                {
+                    size_t j;
+                    for (j = 0; j < count; j++)
+                    {
+                        size_t slot = base[j] + d1 < n ? base[j] + d1 : base[j] + d1 - n;
+                        if (taken[slot])
+                            break;
+                        taken[slot] = 1;
+                        slot_of[order[first + j]] = slot;
+                    }
+                    // keep a full placement, undo a partial one
+                    placed = j == count;
+                    for (size_t u = 0; !placed && u < j; u++)
+                        taken[slot_of[order[first + u]]] = 0;
+                    if (placed)
+                    {
+                        f->displacements[b].d0 = d0;
+                        f->displacements[b].d1 = (uint32_t)d1;
+                    }
+                }
+            }
+        }
+        built = placed;
+    }
+
+    free(starts);
+    free(by_size);
+    free(size_count);
+    free(taken);
+    free(base);
+    return ok && built;
+}
+
+/*
+ * Returns true if the given hash codes are all different, false if not or
+ * if there was an allocation error.
+ */
+static bool gmap_frozen_distinct(const uint64_t* hashes, size_t n)
+{
+    uint64_t* sorted = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    if (sorted == NULL)
+        return false;
+
+    memcpy(sorted, hashes, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), gmap_frozen_compare_hashes);
+    bool distinct = true;
+    for (size_t i = 1; distinct && i < n; i++)
+        distinct = sorted[i] != sorted[i - 1];
+    free(sorted);
+    return distinct;
+}
+
+static int gmap_frozen_compare_hashes(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,80 @@
+#ifndef __GMAP_FROZEN_H__
+#define __GMAP_FROZEN_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "gmap.h"
+
+/**
+ * A read-only view of a map's current pairs, indexed by a minimal perfect
+ * hash function (CHD: hash, displace, and compress).  Every key goes to
+ * its own slot, so a lookup hashes the key once, reads one displacement
+ * and one slot, and calls the comparer once.  The index takes about two
+ * bytes per key beyond the slot array of key and value pointers.
+ *
+ * A frozen map is never changed after it is built, so any number of
+ * threads may look keys up in it at once without locking as long as the
+ * hash and compare functions are themselves safe to call that way.
+ */
+struct _gmap_frozen;
+typedef struct _gmap_frozen gmap_frozen;
+
+/**
+ * Builds a frozen map over the pairs now in the given map.  The frozen
+ * map refers to m's copies of the keys, so m must not have pairs removed,
+ * must not be passed to gmap_shrink_to_fit, and must not be destroyed
+ * while the frozen map is in use: a map made by gmap_create_bytes keeps
+ * short keys inside its nodes, and gmap_shrink_to_fit moves the nodes.
+ * Puts and gmap_reserve leave keys where they are.  Values are recorded
+ * as they are now.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param comp the compare function m was created with
+ * @param h the hash function m was created with
+ * @return a pointer to the frozen map, or NULL if there was an allocation
+ * error or two keys in m have the same hash code; it is the caller's
+ * responsibility to destroy the frozen map
+ */
+gmap_frozen *gmap_freeze(gmap *m, int (*comp)(const void *, const void *), size_t (*h)(const void *));
+
+
+/**
+ * Returns the number of (key, value) pairs in the given frozen map.
+ *
+ * @param f a pointer to a frozen map, non-NULL
+ * @return the size of the frozen map pointed to by f
+ */
+size_t gmap_frozen_size(const gmap_frozen *f);
+
+
+/**
+ * Determines if the given key is present in this frozen map.
+ *
+ * @param f a pointer to a frozen map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return true if a key equal to the one pointed to is present, false otherwise
+ */
+bool gmap_frozen_contains_key(const gmap_frozen *f, const void *key);
+
+
+/**
+ * Returns the value associated with the given key in this frozen map, or
+ * NULL if the key is not present.
+ *
+ * @param f a pointer to a frozen map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return a pointer to the associated value, or NULL if the key is not present
+ */
+void *gmap_frozen_get(const gmap_frozen *f, const void *key);
+
+
+/**
+ * Destroys the given frozen map.  The map it was built from is not
+ * affected.  There is no effect if the given pointer is NULL.
+ *
+ * @param f a pointer to a frozen map, or NULL
+ */
+void gmap_frozen_destroy(gmap_frozen *f);
+
+#endif
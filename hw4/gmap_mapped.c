@@ -0,0 +1,426 @@
+/* CPSC223 Fall 2022 hw4
+ * Snapshot files for gmap that are mapped into memory and queried in place.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "gmap_mapped.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// first bytes of every snapshot file; the digit is the format version
+#define GMAP_MAPPED_MAGIC "GMAPSNP2"
+
+// keys and values start at multiples of this many bytes in the file
+#define GMAP_MAPPED_ALIGN 16
+
+/*
+ * File layout, every offset counted from the start of the file:
+ *   header
+ *   uint64_t starts[nbuckets + 1]: entries of bucket b are [starts[b], starts[b + 1])
+ *   entry entries[nkey], grouped by bucket
+ *   serialized keys and values, each aligned to GMAP_MAPPED_ALIGN
+ */
+typedef struct _gmap_mapped_header
+{
+    char magic[8];
+    uint64_t nkey;
+    uint64_t nbuckets;
+    // length of the whole file, so a truncated copy is not mistaken for one
+    uint64_t length;
+} gmap_mapped_header;
+
+typedef struct _gmap_mapped_entry
+{
+    // hash code of the serialized key
+    uint64_t hash;
+    // offset and size of the serialized key
+    uint64_t key;
+    uint64_t key_size;
+    // offset and size of the serialized value
+    uint64_t value;
+    uint64_t value_size;
+} gmap_mapped_entry;
+
+struct _gmap_mapped
+{
+    // start and length of the mapping
+    const char* base;
+    size_t length;
+    size_t nkey;
+    size_t nbuckets;
+    const uint64_t* starts;
+    const gmap_mapped_entry* entries;
+    int (*comparer)(const void *, const void *);
+    size_t (*hasher)(const void *);
+};
+
+// helper function declarations
+static const gmap_mapped_entry* gmap_mapped_find(const gmap_mapped* m, const void* key);
+static size_t gmap_mapped_pad(size_t size);
+static bool gmap_mapped_write(FILE* out, const void* data, size_t size);
+static bool gmap_mapped_valid(const char* base, size_t length);
+static bool gmap_mapped_within(uint64_t offset, uint64_t size, size_t length);
+static void* gmap_mapped_serialize(size_t (*s)(const void *, void *), const void* obj, void** buffer, size_t* buffer_size, size_t* size);
+
+/**
+ * Writes the given map to a snapshot file.  Keys are hashed in their
+ * serialized form with h, and lookups in the mapped file pass the
+ * serialized keys to the comparer given to gmap_open_mapped, so a key
+ * serializer should write something the hash and compare functions accept
+ * as a key (for strings, the characters and null terminator).  h must
+ * give the same result in every process that opens the file.  The file
+ * is written under a temporary name and renamed over path once complete,
+ * so a failed save leaves any earlier snapshot as it was, and maps of
+ * the earlier snapshot that are still open keep reading it.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param path the name of the file to create or replace, non-NULL
+ * @param ks a pointer to a function that takes a pointer to a key and a
+ * pointer to a buffer, writes the serialized key to the buffer if it is
+ * non-NULL, and returns the size of the serialized key in bytes
+ * @param vs a pointer to a function like ks for values
+ * @param h a pointer to a function that takes a pointer to a serialized
+ * key and returns its hash code
+ * @return true if successful, false if the file could not be written or
+ * there was an allocation error
+ */
+bool gmap_save(gmap *m, const char *path, size_t (*ks)(const void *, void *), size_t (*vs)(const void *, void *), size_t (*h)(const void *))
+{
+    if (m == NULL || path == NULL || ks == NULL || vs == NULL || h == NULL)
+        return false;
+
+    size_t n = gmap_size(m);
+    size_t nbuckets = n | 1;
+    gmap_mapped_entry* entries = malloc((n + 1) * sizeof(gmap_mapped_entry));
+    gmap_mapped_entry* sorted = malloc((n + 1) * sizeof(gmap_mapped_entry));
+    const void** keys = malloc((n + 1) * sizeof(void*));
+    void** values = malloc((n + 1) * sizeof(void*));
+    uint64_t* starts = calloc(nbuckets + 1, sizeof(uint64_t));
+    void* buffer = NULL;
+    size_t buffer_size = 0;
+    FILE* out = NULL;
+    bool ok = entries != NULL && sorted != NULL && keys != NULL && values != NULL && starts != NULL;
+
+    // hash every serialized key and count the entries in each bucket
+    gmap_iter it;
+    gmap_iter_begin(m, &it);
+    for (size_t i = 0; ok && gmap_iter_next(&it, keys + i, values + i); i++)
+    {
+        size_t size;
+        ok = gmap_mapped_serialize(ks, keys[i], &buffer, &buffer_size, &size) != NULL;
+        if (ok)
+        {
+            entries[i].hash = h(buffer);
+            entries[i].key_size = size;
+            entries[i].value_size = vs(values[i], NULL);
+            starts[entries[i].hash % nbuckets + 1]++;
+        }
+    }
+
+    // group entries by bucket and lay out the data after the entries
+    for (size_t b = 0; ok && b < nbuckets; b++)
+        starts[b + 1] += starts[b];
+    size_t table_bytes = sizeof(gmap_mapped_header) + (nbuckets + 1) * sizeof(uint64_t) + n * sizeof(gmap_mapped_entry);
+    uint64_t offset = gmap_mapped_pad(table_bytes);
+    for (size_t i = 0; ok && i < n; i++)
+    {
+        entries[i].key = offset;
+        offset += gmap_mapped_pad(entries[i].key_size);
+        entries[i].value = offset;
+        offset += gmap_mapped_pad(entries[i].value_size);
+    }
+    uint64_t* next = malloc((nbuckets + 1) * sizeof(uint64_t));
+    ok = ok && next != NULL;
+    if (ok)
+    {
+        memcpy(next, starts, (nbuckets + 1) * sizeof(uint64_t));
+        for (size_t i = 0; i < n; i++)
+            sorted[next[entries[i].hash % nbuckets]++] = entries[i];
+    }
+    free(next);
+
+    // a name no other save, in this process or another, is using
+    static unsigned long saves = 0;
+    char* temp = malloc(strlen(path) + 64);
+    int fd = -1;
+    if (ok && temp != NULL)
+    {
+        sprintf(temp, "%s.%ld.%lu.tmp", path, (long)getpid(), __atomic_fetch_add(&saves, 1, __ATOMIC_RELAXED));
+        fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    }
+    ok = ok && fd >= 0 && (out = fdopen(fd, "wb")) != NULL;
+    if (fd >= 0 && out == NULL)
+        close(fd);
+
+    gmap_mapped_header header = {GMAP_MAPPED_MAGIC, n, nbuckets, offset};
+    ok = ok && gmap_mapped_write(out, &header, sizeof(header))
+        && gmap_mapped_write(out, starts, (nbuckets + 1) * sizeof(uint64_t))
+        && gmap_mapped_write(out, sorted, n * sizeof(gmap_mapped_entry))
+        && gmap_mapped_write(out, NULL, gmap_mapped_pad(table_bytes) - table_bytes);
+
+    // then the keys and values in the same order as the offsets were assigned
+    for (size_t i = 0; ok && i < n; i++)
+    {
+        size_t size;
+        ok = gmap_mapped_serialize(ks, keys[i], &buffer, &buffer_size, &size) != NULL
+            && gmap_mapped_write(out, buffer, size)
+            && gmap_mapped_write(out, NULL, gmap_mapped_pad(size) - size)
+            && gmap_mapped_serialize(vs, values[i], &buffer, &buffer_size, &size) != NULL
+            && gmap_mapped_write(out, buffer, size)
+            && gmap_mapped_write(out, NULL, gmap_mapped_pad(size) - size);
+    }
+
+    // the data must reach the disk before the name does
+    ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if (out != NULL && fclose(out) != 0)
+        ok = false;
+    if (fd >= 0)
+    {
+        ok = ok && rename(temp, path) == 0;
+        if (!ok)
+            unlink(temp);
+    }
+    free(temp);
+    free(entries);
+    free(sorted);
+    free(keys);
+    free(values);
+    free(starts);
+    free(buffer);
+    return ok;
+}
+
+/**
+ * Maps the given snapshot file into memory for lookups.
+ *
+ * @param path the name of a file written by gmap_save, non-NULL
+ * @param comp a pointer to a function that takes two keys and returns the
+ * result of comparing them, with return value as for strcmp; the second
+ * key is always a serialized key in the file
+ * @param h the hash function given to gmap_save
+ * @return a pointer to the mapped map, or NULL if the file could not be
+ * opened, is not a complete snapshot, or could not be mapped; it is the
+ * caller's responsibility to close the map
+ */
+gmap_mapped *gmap_open_mapped(const char *path, int (*comp)(const void *, const void *), size_t (*h)(const void *))
+{
+    if (path == NULL || comp == NULL || h == NULL)
+        return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(gmap_mapped_header))
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    size_t length = st.st_size;
+    const gmap_mapped_header* header = base;
+    bool ok = gmap_mapped_valid(base, length);
+
+    gmap_mapped* m = ok ? malloc(sizeof(gmap_mapped)) : NULL;
+    if (m == NULL)
+    {
+        munmap(base, length);
+        return NULL;
+    }
+
+    m->base = base;
+    m->length = length;
+    m->nkey = header->nkey;
+    m->nbuckets = header->nbuckets;
+    m->starts = (const uint64_t*)(m->base + sizeof(gmap_mapped_header));
+    m->entries = (const gmap_mapped_entry*)(m->starts + m->nbuckets + 1);
+    m->comparer = comp;
+    m->hasher = h;
+    return m;
+}
+
+/**
+ * Returns the number of (key, value) pairs in the given mapped map.
+ *
+ * @param m a pointer to a mapped map, non-NULL
+ * @return the size of the map pointed to by m
+ */
+size_t gmap_mapped_size(const gmap_mapped *m)
+{
+    if (m == NULL)
+        return 0;
+
+    return m->nkey;
+}
+
+/**
+ * Determines if the given key is present in this mapped map.
+ *
+ * @param m a pointer to a mapped map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return true if a key equal to the one pointed to is present, false otherwise
+ */
+bool gmap_mapped_contains_key(const gmap_mapped *m, const void *key)
+{
+    if (m == NULL || key == NULL)
+        return false;
+
+    return gmap_mapped_find(m, key) != NULL;
+}
+
+/**
+ * Returns the serialized value associated with the given key, or NULL if
+ * the key is not present.  The value is aligned for any scalar type and
+ * stays valid until the map is closed.
+ *
+ * @param m a pointer to a mapped map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param size a pointer to a size_t set to the size of the value in bytes
+ * if it is found, or NULL
+ * @return a pointer to the serialized value in the file, or NULL
+ */
+const void *gmap_mapped_get(const gmap_mapped *m, const void *key, size_t *size)
+{
+    if (m == NULL || key == NULL)
+        return NULL;
+
+    const gmap_mapped_entry* e = gmap_mapped_find(m, key);
+    if (e == NULL)
+        return NULL;
+
+    if (size != NULL)
+        *size = e->value_size;
+    return m->base + e->value;
+}
+
+/**
+ * Unmaps the given mapped map.  There is no effect if the given pointer
+ * is NULL.
+ *
+ * @param m a pointer to a mapped map, or NULL
+ */
+void gmap_mapped_close(gmap_mapped *m)
+{
+    if (m != NULL)
+    {
+        munmap((void*)m->base, m->length);
+        free(m);
+    }
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+/*
+ * Returns the entry for key, or NULL if it is not in the file.
+ */
+static const gmap_mapped_entry* gmap_mapped_find(const gmap_mapped* m, const void* key)
+{
+    uint64_t hash = m->hasher(key);
+    size_t b = hash % m->nbuckets;
+    for (uint64_t i = m->starts[b]; i < m->starts[b + 1]; i++)
+    {
+        const gmap_mapped_entry* e = m->entries + i;
+        if (e->hash == hash && m->comparer(key, m->base + e->key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+/*
+ * Determines whether the length bytes at base are a whole snapshot whose
+ * every offset stays inside it, so lookups need no checks of their own:
+ * the header matches the file, the buckets' starts run in order from 0
+ * to the number of entries, and each entry's key and value lie in the
+ * file at aligned offsets.
+ */
+static bool gmap_mapped_valid(const char* base, size_t length)
+{
+    const gmap_mapped_header* header = (const gmap_mapped_header*)base;
+    if (memcmp(header->magic, GMAP_MAPPED_MAGIC, sizeof(header->magic)) != 0
+        || header->length != length
+        || header->nbuckets == 0
+        || header->nbuckets >= length / sizeof(uint64_t)
+        || header->nkey >= length / sizeof(gmap_mapped_entry)
+        || sizeof(gmap_mapped_header) + (header->nbuckets + 1) * sizeof(uint64_t) + header->nkey * sizeof(gmap_mapped_entry) > length)
+        return false;
+
+    const uint64_t* starts = (const uint64_t*)(base + sizeof(gmap_mapped_header));
+    if (starts[0] != 0 || starts[header->nbuckets] != header->nkey)
+        return false;
+    for (size_t b = 0; b < header->nbuckets; b++)
+    {
+        if (starts[b] > starts[b + 1])
+            return false;
+    }
+
+    const gmap_mapped_entry* entries = (const gmap_mapped_entry*)(starts + header->nbuckets + 1);
+    for (size_t i = 0; i < header->nkey; i++)
+    {
+        const gmap_mapped_entry* e = entries + i;
+        if (!gmap_mapped_within(e->key, e->key_size, length) || !gmap_mapped_within(e->value, e->value_size, length))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Determines whether size bytes at the given offset lie inside a file of
+ * the given length, starting on an aligned offset.
+ */
+static bool gmap_mapped_within(uint64_t offset, uint64_t size, size_t length)
+{
+    return offset % GMAP_MAPPED_ALIGN == 0 && offset <= length && size <= length - offset;
+}
+
+/*
+ * Round size up to a multiple of GMAP_MAPPED_ALIGN.
+ */
+static size_t gmap_mapped_pad(size_t size)
+{
+    return (size + GMAP_MAPPED_ALIGN - 1) / GMAP_MAPPED_ALIGN * GMAP_MAPPED_ALIGN;
+}
+
+/*
+ * Write size bytes of data to out, or size zero bytes if data is NULL.
+ */
+static bool gmap_mapped_write(FILE* out, const void* data, size_t size)
+{
+    static const char zeros[GMAP_MAPPED_ALIGN];
+    if (data == NULL)
+    {
+        // only ever used for padding, which is shorter than the alignment
+        return size < GMAP_MAPPED_ALIGN && fwrite(zeros, 1, size, out) == size;
+    }
+    return fwrite(data, 1, size, out) == size;
+}
+
+/*
+ * Serialize obj with s into *buffer, growing it as needed, and set *size
+ * to the number of bytes written.  Returns the buffer, or NULL if it could
+ * not be grown.
+ */
+static void* gmap_mapped_serialize(size_t (*s)(const void *, void *), const void* obj, void** buffer, size_t* buffer_size, size_t* size)
+{
+    *size = s(obj, NULL);
+    if (*size > *buffer_size || *buffer == NULL)
+    {
+        size_t grown = *size > 2 * *buffer_size ? *size : 2 * *buffer_size;
+        void* bigger = realloc(*buffer, grown > 0 ? grown : 1);
+        if (bigger == NULL)
+            return NULL;
+        *buffer = bigger;
+        *buffer_size = grown;
+    }
+    s(obj, *buffer);
+    return *buffer;
+}
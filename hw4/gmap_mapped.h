@@ -0,0 +1,107 @@
+#ifndef __GMAP_MAPPED_H__
+#define __GMAP_MAPPED_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "gmap.h"
+
+/**
+ * A read-only map backed by a snapshot file written by gmap_save.  The
+ * file is mapped into memory as it is, so opening it does no work beyond
+ * checking its header and index (one pass over the entries, never
+ * touching keys or values) and lookups can start right away.  A file
+ * that is truncated or whose index points outside it is refused, so
+ * lookups never read past the end of the mapping, although the comparer
+ * must still stop within the serialized key (as strcmp does at the null
+ * terminator a string serializer writes).
+ * Keys and values live in the file in the serialized form written by the
+ * serializers given to gmap_save; every offset in the file is relative to
+ * its start, so the file can be mapped at any address or copied between
+ * machines with the same byte order and word size.
+ */
+struct _gmap_mapped;
+typedef struct _gmap_mapped gmap_mapped;
+
+/**
+ * Writes the given map to a snapshot file.  Keys are hashed in their
+ * serialized form with h, and lookups in the mapped file pass the
+ * serialized keys to the comparer given to gmap_open_mapped, so a key
+ * serializer should write something the hash and compare functions accept
+ * as a key (for strings, the characters and null terminator).  h must
+ * give the same result in every process that opens the file.  The file
+ * is written under a temporary name and renamed over path once complete,
+ * so a failed save leaves any earlier snapshot as it was, and maps of
+ * the earlier snapshot that are still open keep reading it.
+ *
+ * @param m a pointer to a map, non-NULL
+ * @param path the name of the file to create or replace, non-NULL
+ * @param ks a pointer to a function that takes a pointer to a key and a
+ * pointer to a buffer, writes the serialized key to the buffer if it is
+ * non-NULL, and returns the size of the serialized key in bytes
+ * @param vs a pointer to a function like ks for values
+ * @param h a pointer to a function that takes a pointer to a serialized
+ * key and returns its hash code
+ * @return true if successful, false if the file could not be written or
+ * there was an allocation error
+ */
+bool gmap_save(gmap *m, const char *path, size_t (*ks)(const void *, void *), size_t (*vs)(const void *, void *), size_t (*h)(const void *));
+
+
+/**
+ * Maps the given snapshot file into memory for lookups.
+ *
+ * @param path the name of a file written by gmap_save, non-NULL
+ * @param comp a pointer to a function that takes two keys and returns the
+ * result of comparing them, with return value as for strcmp; the second
+ * key is always a serialized key in the file
+ * @param h the hash function given to gmap_save
+ * @return a pointer to the mapped map, or NULL if the file could not be
+ * opened, is not a complete snapshot, or could not be mapped; it is the
+ * caller's responsibility to close the map
+ */
+gmap_mapped *gmap_open_mapped(const char *path, int (*comp)(const void *, const void *), size_t (*h)(const void *));
+
+
+/**
+ * Returns the number of (key, value) pairs in the given mapped map.
+ *
+ * @param m a pointer to a mapped map, non-NULL
+ * @return the size of the map pointed to by m
+ */
+size_t gmap_mapped_size(const gmap_mapped *m);
+
+
+/**
+ * Determines if the given key is present in this mapped map.
+ *
+ * @param m a pointer to a mapped map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @return true if a key equal to the one pointed to is present, false otherwise
+ */
+bool gmap_mapped_contains_key(const gmap_mapped *m, const void *key);
+
+
+/**
+ * Returns the serialized value associated with the given key, or NULL if
+ * the key is not present.  The value is aligned for any scalar type and
+ * stays valid until the map is closed.
+ *
+ * @param m a pointer to a mapped map, non-NULL
+ * @param key a pointer to a key, non-NULL
+ * @param size a pointer to a size_t set to the size of the value in bytes
+ * if it is found, or NULL
+ * @return a pointer to the serialized value in the file, or NULL
+ */
+const void *gmap_mapped_get(const gmap_mapped *m, const void *key, size_t *size);
+
+
+/**
+ * Unmaps the given mapped map.  There is no effect if the given pointer
+ * is NULL.
+ *
+ * @param m a pointer to a mapped map, or NULL
+ */
+void gmap_mapped_close(gmap_mapped *m);
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef __GMAP_TYPED_H__
+#define __GMAP_TYPED_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * A generator for maps specialized to one key type and one value type.
+ *
+ *   GMAP_DEFINE(name, key_type, value_type, hash_fn, eq_fn)
+ *
+ * expands to a type name (an opaque map) and the functions
+ *
+ *   name *name_create(void);
+ *   size_t name_size(const name *m);
+ *   bool name_reserve(name *m, size_t n);
+ *   bool name_put(name *m, key_type key, value_type value);
+ *   value_type *name_get(name *m, key_type key);
+ *   const value_type *name_get_const(const name *m, key_type key);
+ *   bool name_contains_key(const name *m, key_type key);
+ *   bool name_remove(name *m, key_type key, value_type *removed);
+ *   void name_for_each(name *m, void (*f)(const key_type *, value_type *, void *), void *arg);
+ *   void name_destroy(name *m);
+ *
+ * which behave like their gmap counterparts except that keys and values
+ * are stored by value in one array, so nothing is copied or freed through
+ * function pointers.  hash_fn takes a key_type and returns a size_t;
+ * eq_fn takes two key_types and returns nonzero if they are equal.  Both
+ * are called directly and can be inlined, so they are best written as
+ * macros or static inline functions.  key_type and value_type must be
+ * assignable (any scalar or struct type, but not an array).
+ *
+ * name_reserve grows the table once so that n keys fit without further
+ * growth, returning false (and leaving the map as it was) if it could
+ * not.  name_put returns false only if the table could not grow; name_get
+ * returns a pointer to the stored value, valid until the next put or
+ * remove (name_get_const does the same through a const map);
+ * name_remove stores the removed value through removed if it is
+ * non-NULL.  Use gmap.h for keys that need deep copies.
+ *
+ * The table uses linear probing with at most 3/4 of the slots full, and
+ * removal shifts later entries back so no tombstones are left behind.
+ */
+#define GMAP_DEFINE(name, key_type, value_type, hash_fn, eq_fn) \
+                                                                        \
+typedef struct name##_slot                                              \
+{                                                                       \
+    key_type key;                                                       \
+    value_type value;                                                   \
+} name##_slot;                                                          \
+                                                                        \
+typedef struct name                                                     \
+{                                                                       \
+    name##_slot *slots;                                                 \
+    unsigned char *used;                                                \
+    size_t cap;                                                         \
+    size_t nkey;                                                        \
+} name;                                                                 \
+                                                                        \
+static inline size_t name##_home(const name *m, key_type key)          \
+{                                                                       \
+    return gmap_typed_mix((size_t)(hash_fn(key))) & (m->cap - 1);     \
+}                                                                       \
+                                                                        \
+static inline size_t name##_find(const name *m, key_type key)          \
+{                                                                       \
+    size_t i = name##_home(m, key);                                     \
+    while (m->used[i])                                                  \
+    {                                                                   \
+        if (eq_fn(m->slots[i].key, key))                                \
+            return i;                                                   \
+        i = (i + 1) & (m->cap - 1);                                     \
+    }                                                                   \
+    return m->cap;                                                      \
+}                                                                       \
+                                                                        \
+static inline bool name##_alloc(name *m, size_t cap)                   \
+{                                                                       \
+    name##_slot *slots = malloc(cap * sizeof(name##_slot));             \
+    unsigned char *used = calloc(cap, 1);                               \
+    if (slots == NULL || used == NULL)                                  \
+    {                                                                   \
+        free(slots);                                                    \
+        free(used);                                                     \
+        return false;                                                   \
+    }                                                                   \
+    m->slots = slots;                                                   \
+    m->used = used;                                                     \
+    m->cap = cap;                                                       \
+    return true;                                                        \
+}                                                                       \
+                                                                        \
+static inline name *name##_create(void)                                 \
+{                                                                       \
+    name *m = malloc(sizeof(name));                                     \
+    if (m != NULL && !name##_alloc(m, GMAP_TYPED_INITIAL_CAPACITY))     \
+    {                                                                   \
+        free(m);                                                        \
+        return NULL;                                                    \
+    }                                                                   \
+    if (m != NULL)                                                      \
+        m->nkey = 0;                                                    \
+    return m;                                                           \
+}                                                                       \
+                                                                        \
+static inline size_t name##_size(const name *m)                         \
+{                                                                       \
+    return m == NULL ? 0 : m->nkey;                                     \
+}                                                                       \
+                                                                        \
+static inline bool name##_rehash(name *m, size_t cap)                   \
+{                                                                       \
+    name##_slot *oldslots = m->slots;                                   \
+    unsigned char *oldused = m->used;                                   \
+    size_t oldcap = m->cap;                                             \
+    if (!name##_alloc(m, cap))                                          \
+        return false;                                                   \
+    for (size_t j = 0; j < oldcap; j++)                                 \
+    {                                                                   \
+        if (oldused[j])                                                 \
+        {                                                               \
+            size_t i = name##_home(m, oldslots[j].key);                 \
+            while (m->used[i])                                          \
+                i = (i + 1) & (m->cap - 1);                             \
+            m->used[i] = 1;                                             \
+            m->slots[i] = oldslots[j];                                  \
+        }                                                               \
+    }                                                                   \
+    free(oldslots);                                                     \
+    free(oldused);                                                      \
+    return true;                                                        \
+}                                                                       \
+                                                                        \
+static inline bool name##_grow(name *m)                                 \
+{                                                                       \
+    return name##_rehash(m, m->cap * 2);                                \
+}                                                                       \
+                                                                        \
+static inline bool name##_reserve(name *m, size_t n)                    \
+{                                                                       \
+    size_t cap = m->cap;                                                \
+    while (n * 4 > cap * 3)                                             \
+        cap *= 2;                                                       \
+    return cap == m->cap || name##_rehash(m, cap);                      \
+}                                                                       \
+                                                                        \
+static inline bool name##_put(name *m, key_type key, value_type value)  \
+{                                                                       \
+    if ((m->nkey + 1) * 4 > m->cap * 3 && !name##_grow(m))              \
+        return false;                                                   \
+    size_t i = name##_home(m, key);                                     \
+    while (m->used[i])                                                  \
+    {                                                                   \
+        if (eq_fn(m->slots[i].key, key))                                \
+        {                                                               \
+            m->slots[i].value = value;                                  \
+            return true;                                                \
+        }                                                               \
+        i = (i + 1) & (m->cap - 1);                                     \
+    }                                                                   \
+    m->used[i] = 1;                                                     \
+    m->slots[i].key = key;                                              \
+    m->slots[i].value = value;                                          \
+    m->nkey++;                                                          \
+    return true;                                                        \
+}                                                                       \
+                                                                        \
+static inline value_type *name##_get(name *m, key_type key)             \
+{                                                                       \
+    size_t i = name##_find(m, key);                                     \
+    return i == m->cap ? NULL : &m->slots[i].value;                     \
+}                                                                       \
+                                                                        \
+static inline const value_type *name##_get_const(const name *m, key_type key) \
+{                                                                       \
+    size_t i = name##_find(m, key);                                     \
+    return i == m->cap ? NULL : &m->slots[i].value;                     \
+}                                                                       \
+                                                                        \
+static inline bool name##_contains_key(const name *m, key_type key)     \
+{                                                                       \
+    return name##_find(m, key) != m->cap;                               \
+}                                                                       \
+                                                                        \
+static inline bool name##_remove(name *m, key_type key, value_type *removed) \
+{                                                                       \
+    size_t i = name##_find(m, key);                                     \
+    if (i == m->cap)                                                    \
+        return false;                                                   \
+    if (removed != NULL)                                                \
+        *removed = m->slots[i].value;                                   \
+    /* move back any later entry whose probe passed through slot i */   \
+    size_t j = i;                                                       \
+    while (true)                                                        \
+    {                                                                   \
+        j = (j + 1) & (m->cap - 1);                                     \
+        if (!m->used[j])                                                \
+            break;                                                      \
+        size_t home = name##_home(m, m->slots[j].key);                  \
+        if (((j - home) & (m->cap - 1)) >= ((j - i) & (m->cap - 1)))    \
+        {                                                               \
+            m->slots[i] = m->slots[j];                                  \
+            i = j;                                                      \
+        }                                                               \
+    }                                                                   \
+    m->used[i] = 0;                                                     \
+    m->nkey--;                                                          \
+    return true;                                                        \
+}                                                                       \
+                                                                        \
+static inline void name##_for_each(name *m, void (*f)(const key_type *, value_type *, void *), void *arg) \
+{                                                                       \
+    for (size_t i = 0; i < m->cap; i++)                                 \
+    {                                                                   \
+        if (m->used[i])                                                 \
+            f(&m->slots[i].key, &m->slots[i].value, arg);               \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static inline void name##_destroy(name *m)                              \
+{                                                                       \
+    if (m != NULL)                                                      \
+    {                                                                   \
+        free(m->slots);                                                 \
+        free(m->used);                                                  \
+        free(m);                                                        \
+    }                                                                   \
+}
+
+// must be a power of two
+#define GMAP_TYPED_INITIAL_CAPACITY 128
+
+/**
+ * Spreads the bits of a hash code (the murmur3 64-bit finalizer), so that
+ * simple hashes such as the identity on ints use every slot index bit.
+ */
+static inline size_t gmap_typed_mix(size_t h)
+{
+    unsigned long long x = h;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+#endif
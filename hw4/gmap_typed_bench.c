@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "gmap.h"
+#include "gmap_typed.h"
+#include "string_key.h"
+
+/**
+ * Compares a map generated by GMAP_DEFINE with the generic gmap on the
+ * same work: put n keys, get each of them, get n keys that are not
+ * present, and remove every key, with keys in a shuffled order.
+ *
+ * USAGE: GmapTypedBench [n]
+ *
+ * Two key types are timed: ints, and 31-character ids (the longest Blotto
+ * allows), which the typed map holds by value in 32-byte structs and gmap
+ * holds as strings in a gmap_create_bytes map.
+ */
+
+#define DEFAULT_KEYS 1000000
+#define ID_LENGTH 31
+
+// a Blotto id held by value; the unused tail is zero
+typedef struct _id
+{
+  char s[ID_LENGTH + 1];
+} id;
+
+static inline size_t hash_int(int k)
+{
+  return (size_t)k;
+}
+
+static inline int equal_ints(int a, int b)
+{
+  return a == b;
+}
+
+static inline size_t hash_id(id k)
+{
+  // the four words of the id, each multiplied in
+  uint64_t w[4];
+  memcpy(w, k.s, sizeof(w));
+  uint64_t h = w[0] * 0x9E3779B185EBCA87ULL;
+  h = (h ^ (h >> 29) ^ w[1]) * 0xC2B2AE3D27D4EB4FULL;
+  h = (h ^ (h >> 29) ^ w[2]) * 0x165667B19E3779F9ULL;
+  h = (h ^ (h >> 29) ^ w[3]) * 0x9E3779B185EBCA87ULL;
+  return (size_t)(h ^ (h >> 32));
+}
+
+static inline int equal_ids(id a, id b)
+{
+  return memcmp(a.s, b.s, sizeof(a.s)) == 0;
+}
+
+GMAP_DEFINE(int_map, int, int, hash_int, equal_ints)
+GMAP_DEFINE(id_map, id, int, hash_id, equal_ids)
+
+void *copy_int(const void *key);
+int compare_ints(const void *a, const void *b);
+size_t hash_int_pointer(const void *key);
+double seconds_since(const struct timespec *start);
+void shuffle(size_t *order, size_t n);
+void print_row(const char *keys, const char *map, size_t n, const double *secs);
+void bench_ints(size_t n, const size_t *order);
+void bench_ids(size_t n, const size_t *order);
+
+int main(int argc, char **argv)
+{
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_KEYS;
+  if (n < 1)
+    {
+      fprintf(stderr, "USAGE: %s [n]\n", argv[0]);
+      return 1;
+    }
+
+  size_t *order = malloc(sizeof(size_t) * n);
+  for (size_t i = 0; i < n; i++)
+    {
+      order[i] = i;
+    }
+  shuffle(order, n);
+
+  printf("%-6s %-8s %10s %10s %10s %10s\n", "keys", "map", "put ns", "hit ns", "miss ns", "remove ns");
+  bench_ints(n, order);
+  bench_ids(n, order);
+
+  free(order);
+  return 0;
+}
+
+void bench_ints(size_t n, const size_t *order)
+{
+  int *keys = malloc(sizeof(int) * 2 * n);
+  for (size_t i = 0; i < 2 * n; i++)
+    {
+      // keys [0, n) are put, keys [n, 2n) are the misses
+      keys[i] = (int)(i * 2654435761u);
+    }
+  double secs[4];
+  struct timespec start;
+  volatile size_t sink = 0;
+
+  int_map *t = int_map_create();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    int_map_put(t, keys[order[i]], (int)i);
+  secs[0] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += *int_map_get(t, keys[i]);
+  secs[1] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += int_map_get(t, keys[n + i]) == NULL;
+  secs[2] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += int_map_remove(t, keys[order[i]], NULL);
+  secs[3] = seconds_since(&start);
+  print_row("int", "typed", n, secs);
+  int_map_destroy(t);
+
+  gmap *m = gmap_create(copy_int, compare_ints, hash_int_pointer, free);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    gmap_put(m, keys + order[i], keys + i);
+  secs[0] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += *(int *)gmap_get(m, keys + i);
+  secs[1] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += gmap_get(m, keys + n + i) == NULL;
+  secs[2] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += gmap_remove(m, keys + order[i]) != NULL;
+  secs[3] = seconds_since(&start);
+  print_row("int", "gmap", n, secs);
+  gmap_destroy(m);
+
+  free(keys);
+}
+
+void bench_ids(size_t n, const size_t *order)
+{
+  id *keys = calloc(2 * n, sizeof(id));
+  for (size_t i = 0; i < 2 * n; i++)
+    {
+      // a common prefix, as with generated ids, and the index at the end
+      snprintf(keys[i].s, sizeof(keys[i].s), "player-id-with-a-long-%09u", (unsigned)(i % 1000000000));
+    }
+  double secs[4];
+  struct timespec start;
+  volatile size_t sink = 0;
+
+  id_map *t = id_map_create();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    id_map_put(t, keys[order[i]], (int)i);
+  secs[0] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += *id_map_get(t, keys[i]);
+  secs[1] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += id_map_get(t, keys[n + i]) == NULL;
+  secs[2] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += id_map_remove(t, keys[order[i]], NULL);
+  secs[3] = seconds_since(&start);
+  print_row("id31", "typed", n, secs);
+  id_map_destroy(t);
+
+  gmap *m = gmap_create_bytes(string_key_size, compare_keys, hash_string_wy);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    gmap_put(m, keys[order[i]].s, keys + i);
+  secs[0] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += gmap_get(m, keys[i].s) != NULL;
+  secs[1] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += gmap_get(m, keys[n + i].s) == NULL;
+  secs[2] = seconds_since(&start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < n; i++)
+    sink += gmap_remove(m, keys[order[i]].s) != NULL;
+  secs[3] = seconds_since(&start);
+  print_row("id31", "gmap", n, secs);
+  gmap_destroy(m);
+
+  free(keys);
+}
+
+void print_row(const char *keys, const char *map, size_t n, const double *secs)
+{
+  printf("%-6s %-8s %10.1f %10.1f %10.1f %10.1f\n", keys, map,
+	 secs[0] * 1e9 / n, secs[1] * 1e9 / n, secs[2] * 1e9 / n, secs[3] * 1e9 / n);
+}
+
+void *copy_int(const void *key)
+{
+  int *copy = malloc(sizeof(int));
+  if (copy != NULL)
+    {
+      *copy = *(const int *)key;
+    }
+  return copy;
+}
+
+int compare_ints(const void *a, const void *b)
+{
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+size_t hash_int_pointer(const void *key)
+{
+  // the same mixing the typed map applies to its hash codes
+  return gmap_typed_mix((size_t)*(const int *)key);
+}
+
+void shuffle(size_t *order, size_t n)
+{
+  srand(223);
+  for (size_t i = n - 1; i > 0; i--)
+    {
+      size_t j = (((size_t)rand() << 16) ^ (size_t)rand()) % (i + 1);
+      size_t tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+}
+
+double seconds_since(const struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
@@ -1,10 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "gmap.h"
+#include "gmap_frozen.h"
+#include "gmap_mapped.h"
+#include "gmap_typed.h"
 #include "gmap_test_functions.h"
 #include "string_key.h"
+#include "string_pool.h"
 
 void test_initial_size(size_t size, int on);
 void test_get();
@@ -21,24 +30,52 @@ void test_remove_destroy();
 void test_large_map(size_t n, size_t (*hash)(const void *));
 void test_for_each(size_t n);
 void test_put_time(size_t n, int on, size_t (*hash)(const void *));
+void test_put_latency(size_t n, int on, size_t (*hash)(const void *), bool incremental);
 void test_for_each_time(size_t n, int on, size_t (*hash)(const void *));
 void test_uses_hash(size_t n);
 void test_keys_survive_embiggen(size_t n1, size_t n2);
 void test_other_types();
+void test_embiggen_does_not_rehash(size_t n);
+void test_incremental_resize(size_t n);
+void test_bytes_keys(size_t n);
+void test_single_probe_apis(size_t n);
+void test_iterator(size_t n, size_t parts);
+void test_reserve_and_shrink(size_t n);
+void test_mapped_snapshot(size_t n);
+void test_print_stats(size_t n);
+void test_typed_map(size_t n);
+void test_frozen(size_t n);
+void test_build_parallel(size_t n, size_t nthreads);
+void test_miss_filter(size_t n);
+void test_counter(size_t n);
+void test_string_pool(size_t n);
+void test_for_each_parallel(size_t n, size_t nthreads);
 
 size_t printing_hash_string(const void *s);
+size_t counting_hash_string(const void *s);
 int compare_key_pointers(const void *k1, const void *k2);
+int compare_longs(const void *p1, const void *p2);
+size_t int_value_write(const void *value, void *dest);
 
 gmap *make_map(const char *prefix, size_t n, int value);
 void add_keys(gmap *m, char * const *keys, size_t n, int value);
 void add_keys_with_values(gmap *m, char * const *keys, size_t n, int *values);
 
 void gmap_unit_free_value(const void *key, void *value, void *arg);
+void gmap_unit_sum_counts(const void *key, void *value, void *arg);
+void gmap_unit_tally(const void *key, void *value, void *arg);
+
+// a poor hash, so that removals have long runs of colliding keys to repair
+#define LONG_HASH(k) ((size_t)((k) / 8))
+#define LONG_EQ(a, b) ((a) == (b))
+GMAP_DEFINE(long_map, long, long, LONG_HASH, LONG_EQ)
 
 #define SMALL_TEST_SIZE 4
 #define MEDIUM_TEST_SIZE 1000
 #define LARGE_TEST_SIZE 100000
 #define VERY_LARGE_TEST_SIZE 1000000
+// longer than one of the string pool's blocks
+#define LONG_POOL_KEY_SIZE 20000
 
 int main(int argc, char **argv)
 {
@@ -154,6 +191,75 @@ int main(int argc, char **argv)
       test_get_time(n, on, hash_string_first);
       break;
 
+    case 23:
+      test_embiggen_does_not_rehash(MEDIUM_TEST_SIZE);
+      break;
+
+    case 24:
+      test_incremental_resize(LARGE_TEST_SIZE);
+      break;
+
+    case 25:
+      test_put_latency(n, on, java_hash_string, false);
+      break;
+
+    case 26:
+      test_put_latency(n, on, java_hash_string, true);
+      break;
+
+    case 27:
+      test_bytes_keys(MEDIUM_TEST_SIZE);
+      break;
+
+    case 28:
+      test_single_probe_apis(MEDIUM_TEST_SIZE);
+      break;
+
+    case 29:
+      test_iterator(MEDIUM_TEST_SIZE, 3);
+      break;
+
+    case 30:
+      test_reserve_and_shrink(LARGE_TEST_SIZE);
+      break;
+
+    case 31:
+      test_mapped_snapshot(MEDIUM_TEST_SIZE);
+      break;
+
+    case 32:
+      // search and resize counts need GmapUnitStats (built with GMAP_STATS)
+      test_print_stats(n > 0 ? n : MEDIUM_TEST_SIZE * 10);
+      break;
+
+    case 33:
+      test_typed_map(LARGE_TEST_SIZE);
+      break;
+
+    case 34:
+      test_frozen(LARGE_TEST_SIZE);
+      break;
+
+    case 35:
+      test_build_parallel(LARGE_TEST_SIZE, 4);
+      break;
+
+    case 36:
+      test_miss_filter(LARGE_TEST_SIZE);
+      break;
+
+    case 37:
+      test_counter(LARGE_TEST_SIZE);
+      break;
+
+    case 38:
+      test_string_pool(LARGE_TEST_SIZE);
+      break;
+
+    case 39:
+      test_for_each_parallel(LARGE_TEST_SIZE, 4);
+      break;
+
     default:
       fprintf(stderr, "USAGE: %s test-number\n", argv[0]);
     }
@@ -632,6 +738,47 @@ void test_put_time(size_t n, int on, size_t (*hash)(const void *))
   free_words(keys, n);
 }
 
+int compare_longs(const void *p1, const void *p2)
+{
+  long x = *(const long *)p1;
+  long y = *(const long *)p2;
+  return (x > y) - (x < y);
+}
+
+
+void test_put_latency(size_t n, int on, size_t (*hash)(const void *), bool incremental)
+{
+  gmap *m = gmap_create(duplicate, compare_keys, hash, free);
+  // a backend that cannot resize incrementally is timed all at once
+  bool applied = gmap_set_incremental_resize(m, incremental);
+  char **keys = make_random_words(10, n);
+  int *values = calloc(n, sizeof(int));
+  long *nanos = malloc(sizeof(long) * n);
+
+  if (on == 1 && n > 0)
+    {
+      // time each put individually so resize pauses show up in the tail
+      for (size_t i = 0; i < n; i++)
+	{
+	  struct timespec start, end;
+	  clock_gettime(CLOCK_MONOTONIC, &start);
+	  gmap_put(m, keys[i], values + i);
+	  clock_gettime(CLOCK_MONOTONIC, &end);
+	  nanos[i] = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+	}
+
+      qsort(nanos, n, sizeof(*nanos), compare_longs);
+      printf("%s resize: p50 %ld ns, p99 %ld ns, max %ld ns per put\n",
+	     !incremental ? "all-at-once" : applied ? "incremental" : "all-at-once (incremental not supported)",
+	     nanos[n / 2], nanos[n * 99 / 100], nanos[n - 1]);
+    }
+
+  free(nanos);
+  free(values);
+  gmap_destroy(m);
+  free_words(keys, n);
+}
+
 void count_keys(const void *key, void *value, void *p)
 {
   (*((int *)p))++;
@@ -958,3 +1105,1001 @@ void test_remove_collision()
   free(btr_value);
   gmap_destroy(m);
 }
+
+
+size_t hash_calls = 0;
+
+size_t counting_hash_string(const void *s)
+{
+  hash_calls++;
+  return java_hash_string(s);
+}
+
+
+void test_embiggen_does_not_rehash(size_t n)
+{
+  gmap *m = gmap_create(duplicate, compare_keys, counting_hash_string, free);
+  char **keys = make_words("word", n);
+  int *values = calloc(n, sizeof(int));
+
+  // enough keys to force several embiggens; each put should hash once
+  hash_calls = 0;
+  add_keys_with_values(m, keys, n, values);
+
+  if (hash_calls != n)
+    {
+      printf("FAILED -- hash function called %zu times for %zu puts\n", hash_calls, n);
+      goto destroy_map;
+    }
+
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gmap_get(m, keys[i]) != values + i)
+	{
+	  printf("FAILED -- incorrect value for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+}
+
+
+void test_incremental_resize(size_t n)
+{
+  gmap *m = gmap_create(duplicate, compare_keys, java_hash_string, free);
+  // a backend that cannot resize incrementally still has to get the same
+  // answers resizing all at once
+  bool applied = gmap_set_incremental_resize(m, true);
+  char **keys = make_words("word", n);
+  int *values = calloc(n, sizeof(int));
+
+  // interleave puts with gets and removes of earlier keys so that
+  // operations hit both tables while resizes are in progress
+  for (size_t i = 0; i < n; i++)
+    {
+      gmap_put(m, keys[i], values + i);
+
+      // every third key is removed right after it is added
+      size_t j = i / 2;
+      if (gmap_get(m, keys[j]) != (j % 3 == 2 ? NULL : values + j))
+	{
+	  printf("FAILED -- incorrect value for key %s after %zu puts\n", keys[j], i + 1);
+	  goto destroy_map;
+	}
+      if (i % 3 == 2)
+	{
+	  gmap_remove(m, keys[i]);
+	}
+    }
+
+  size_t expected = n - n / 3;
+  if (gmap_size(m) != expected)
+    {
+      printf("FAILED -- size is %zu; should be %zu\n", gmap_size(m), expected);
+      goto destroy_map;
+    }
+
+  int count = 0;
+  gmap_for_each(m, count_keys, &count);
+  if (count != expected)
+    {
+      printf("FAILED -- iterated over %d keys; should be %zu\n", count, expected);
+      goto destroy_map;
+    }
+
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gmap_contains_key(m, keys[i]) != (i % 3 != 2))
+	{
+	  printf("FAILED -- wrong membership for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  // switching the mode off finishes any resize in progress
+  gmap_set_incremental_resize(m, false);
+  for (size_t i = 0; i < n; i += 3)
+    {
+      if (gmap_get(m, keys[i]) != values + i)
+	{
+	  printf("FAILED -- incorrect value for key %s after finishing resize\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+  if (applied)
+    {
+      PRINT_PASSED;
+    }
+  else
+    {
+      printf("PASSED -- incremental resizing not supported; resized all at once\n");
+    }
+  return;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+}
+
+
+void test_bytes_keys(size_t n)
+{
+  gmap *m = gmap_create_bytes(string_key_size, compare_keys, java_hash_string);
+
+  // short keys come from the map's slabs; the long ones fall back to the heap
+  char **short_keys = make_words("word", n);
+  char **long_keys = make_words("a key that is much too long to fit in any of the slab size classes ", n);
+  int *values = calloc(2 * n, sizeof(int));
+  add_keys_with_values(m, short_keys, n, values);
+  add_keys_with_values(m, long_keys, n, values + n);
+
+  // the map must have its own copies
+  strcpy(short_keys[0], "changed");
+
+  // remove every other key then put them back to reuse freed space
+  for (size_t i = 1; i < n; i += 2)
+    {
+      gmap_remove(m, short_keys[i]);
+      gmap_remove(m, long_keys[i]);
+    }
+  if (gmap_size(m) != n)
+    {
+      printf("FAILED -- size is %zu after removes; should be %zu\n", gmap_size(m), n);
+      goto destroy_map;
+    }
+  for (size_t i = 1; i < n; i += 2)
+    {
+      gmap_put(m, short_keys[i], values + i);
+      gmap_put(m, long_keys[i], values + n + i);
+    }
+
+  if (gmap_size(m) != 2 * n)
+    {
+      printf("FAILED -- size is %zu; should be %zu\n", gmap_size(m), 2 * n);
+      goto destroy_map;
+    }
+  if (gmap_get(m, "word0") != values || gmap_contains_key(m, "changed"))
+    {
+      printf("FAILED -- key in map changed\n");
+      goto destroy_map;
+    }
+  for (size_t i = 1; i < n; i++)
+    {
+      if (gmap_get(m, short_keys[i]) != values + i || gmap_get(m, long_keys[i]) != values + n + i)
+	{
+	  printf("FAILED -- incorrect value for key %s\n", short_keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  gmap_destroy(m);
+  free_words(short_keys, n);
+  free_words(long_keys, n);
+  free(values);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(short_keys, n);
+  free_words(long_keys, n);
+  free(values);
+}
+
+
+void *add_one(void *old, bool present, void *arg)
+{
+  // a missing key starts with the counter passed as arg
+  int *count = present ? old : arg;
+  (*count)++;
+  return count;
+}
+
+
+void test_single_probe_apis(size_t n)
+{
+  gmap *m = gmap_create(duplicate, compare_keys, counting_hash_string, free);
+  char **keys = make_words("word", n);
+  int *counts = calloc(n, sizeof(int));
+
+  hash_calls = 0;
+  for (size_t i = 0; i < n; i++)
+    {
+      // first get_or_put adds, second finds the existing value
+      if (gmap_get_or_put(m, keys[i], counts + i) != counts + i
+	  || gmap_get_or_put(m, keys[i], NULL) != counts + i)
+	{
+	  printf("FAILED -- get_or_put returned wrong value for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  for (size_t i = 0; i < n; i++)
+    {
+      gmap_upsert(m, keys[i], add_one, NULL);
+      gmap_upsert(m, keys[i], add_one, NULL);
+    }
+  gmap_upsert(m, "new", add_one, counts);
+
+  if (hash_calls != 4 * n + 1)
+    {
+      printf("FAILED -- hash function called %zu times for %zu operations\n", hash_calls, 4 * n + 1);
+      goto destroy_map;
+    }
+
+  if (gmap_size(m) != n + 1 || *counts != 3 || counts[n - 1] != 2)
+    {
+      printf("FAILED -- upsert did not update values\n");
+      goto destroy_map;
+    }
+
+  void **slot = gmap_lookup(m, keys[1]);
+  if (slot == NULL || *slot != counts + 1 || gmap_lookup(m, "missing") != NULL)
+    {
+      printf("FAILED -- lookup returned wrong handle\n");
+      goto destroy_map;
+    }
+  *slot = counts;
+  if (gmap_get(m, keys[1]) != counts)
+    {
+      printf("FAILED -- value not replaced through handle\n");
+      goto destroy_map;
+    }
+
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(counts);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(counts);
+}
+
+
+void test_iterator(size_t n, size_t parts)
+{
+  gmap *m = gmap_create(duplicate, compare_keys, java_hash_string, free);
+  gmap_set_incremental_resize(m, true);
+  char **keys = make_words("word", n);
+  int *seen = calloc(n, sizeof(int));
+
+  // values point into seen so each visit can be counted
+  add_keys_with_values(m, keys, n, seen);
+
+  // a full pass, possibly with a resize still in progress
+  gmap_iter it;
+  const void *key;
+  void *value;
+  size_t count = 0;
+  gmap_iter_begin(m, &it);
+  while (gmap_iter_next(&it, &key, &value))
+    {
+      // no map calls here: in incremental mode even gmap_get moves entries
+      if (strcmp(key, keys[(int *)value - seen]) != 0)
+	{
+	  printf("FAILED -- iterator returned wrong value for key %s\n", (const char *)key);
+	  goto destroy_map;
+	}
+      count++;
+    }
+  if (count != n)
+    {
+      printf("FAILED -- iterated over %zu keys; should be %zu\n", count, n);
+      goto destroy_map;
+    }
+
+  // split the buckets into parts; together they should visit each key once
+  size_t buckets = gmap_bucket_count(m);
+  for (size_t p = 0; p < parts; p++)
+    {
+      gmap_iter_range(m, &it, buckets * p / parts, buckets * (p + 1) / parts);
+      while (gmap_iter_next(&it, NULL, &value))
+	{
+	  (*(int *)value)++;
+	}
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+      if (seen[i] != 1)
+	{
+	  printf("FAILED -- key %s visited %d times by ranges\n", keys[i], seen[i]);
+	  goto destroy_map;
+	}
+    }
+
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(seen);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(seen);
+}
+
+
+void test_reserve_and_shrink(size_t n)
+{
+  gmap *m = gmap_create_bytes(string_key_size, compare_keys, java_hash_string);
+  char **keys = make_words("word", n);
+  int *values = malloc(sizeof(int) * n);
+
+  if (!gmap_reserve(m, n))
+    {
+      printf("FAILED -- could not reserve %zu keys\n", n);
+      goto destroy_map;
+    }
+  size_t reserved = gmap_bucket_count(m);
+  add_keys_with_values(m, keys, n, values);
+  if (gmap_bucket_count(m) != reserved)
+    {
+      printf("FAILED -- map resized from %zu to %zu buckets after reserve\n", reserved, gmap_bucket_count(m));
+      goto destroy_map;
+    }
+
+  // drain all but every tenth key, then give the space back
+  for (size_t i = 0; i < n; i++)
+    {
+      if (i % 10 != 0)
+	{
+	  gmap_remove(m, keys[i]);
+	}
+    }
+  gmap_shrink_to_fit(m);
+  if (gmap_bucket_count(m) >= reserved)
+    {
+      printf("FAILED -- shrink_to_fit left %zu buckets\n", gmap_bucket_count(m));
+      goto destroy_map;
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gmap_get(m, keys[i]) != (i % 10 == 0 ? values + i : NULL))
+	{
+	  printf("FAILED -- incorrect value for key %s after shrink\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  // the shrunk map still grows normally
+  add_keys_with_values(m, keys, n, values);
+  if (gmap_size(m) != n || gmap_get(m, keys[n - 1]) != values + n - 1)
+    {
+      printf("FAILED -- could not refill map after shrink\n");
+      goto destroy_map;
+    }
+
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+}
+
+
+size_t int_value_write(const void *value, void *dest)
+{
+  if (dest != NULL)
+    {
+      memcpy(dest, value, sizeof(int));
+    }
+  return sizeof(int);
+}
+
+
+void test_mapped_snapshot(size_t n)
+{
+  const char *path = "gmap_unit_snapshot.tmp";
+  gmap *m = gmap_create(duplicate, compare_keys, java_hash_string, free);
+  char **keys = make_words("word", n);
+  int *values = malloc(sizeof(int) * n);
+  gmap_mapped *mapped = NULL;
+  for (size_t i = 0; i < n; i++)
+    {
+      values[i] = (int)i * 3;
+    }
+  add_keys_with_values(m, keys, n, values);
+
+  if (!gmap_save(m, path, string_key_write, int_value_write, java_hash_string)
+      || (mapped = gmap_open_mapped(path, compare_keys, java_hash_string)) == NULL)
+    {
+      printf("FAILED -- could not save and map %s\n", path);
+      goto destroy_map;
+    }
+
+  // the snapshot answers on its own once the original map is gone
+  gmap_destroy(m);
+  m = NULL;
+  if (gmap_mapped_size(mapped) != n)
+    {
+      printf("FAILED -- mapped size is %zu; should be %zu\n", gmap_mapped_size(mapped), n);
+      goto destroy_map;
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+      size_t size = 0;
+      const int *value = gmap_mapped_get(mapped, keys[i], &size);
+      if (value == NULL || size != sizeof(int) || *value != values[i])
+	{
+	  printf("FAILED -- incorrect mapped value for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+  if (gmap_mapped_contains_key(mapped, "missing") || gmap_mapped_get(mapped, "word", NULL) != NULL)
+    {
+      printf("FAILED -- mapped map has a key that was not saved\n");
+      goto destroy_map;
+    }
+
+  // saving again replaces the file without disturbing the open mapping
+  m = gmap_create(duplicate, compare_keys, java_hash_string, free);
+  if (!gmap_save(m, path, string_key_write, int_value_write, java_hash_string)
+      || gmap_mapped_get(mapped, keys[n - 1], NULL) == NULL)
+    {
+      printf("FAILED -- saving over an open snapshot disturbed it\n");
+      goto destroy_map;
+    }
+  gmap_destroy(m);
+  m = NULL;
+  gmap_mapped_close(mapped);
+  mapped = NULL;
+
+  // a truncated snapshot is refused rather than read past its end
+  m = gmap_create(duplicate, compare_keys, java_hash_string, free);
+  add_keys_with_values(m, keys, n, values);
+  struct stat st;
+  if (!gmap_save(m, path, string_key_write, int_value_write, java_hash_string) || stat(path, &st) != 0)
+    {
+      printf("FAILED -- could not save %s again\n", path);
+      goto destroy_map;
+    }
+  off_t cuts[] = {1, 5000, 100000};
+  for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++)
+    {
+      if (cuts[c] < st.st_size && truncate(path, st.st_size - cuts[c]) == 0
+	  && (mapped = gmap_open_mapped(path, compare_keys, java_hash_string)) != NULL)
+	{
+	  printf("FAILED -- opened a snapshot missing its last %ld bytes\n", (long)cuts[c]);
+	  goto destroy_map;
+	}
+    }
+
+  gmap_destroy(m);
+  remove(path);
+  free_words(keys, n);
+  free(values);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_mapped_close(mapped);
+  remove(path);
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+}
+
+
+void test_print_stats(size_t n)
+{
+  struct
+  {
+    const char *name;
+    size_t (*hash)(const void *);
+  } hashes[] = {
+    {"java", java_hash_string},
+    {"sum", hash_string_sum},
+    {"first", hash_string_first},
+    {"wy", hash_string_wy},
+  };
+  char **keys = make_words("word", n);
+  char **missing = make_words("miss", n);
+  int *values = malloc(sizeof(int) * n);
+  bool passed = true;
+
+  printf("%-6s %6s %8s", "hash", "load", "buckets");
+  for (int len = 0; len < GMAP_STATS_HISTOGRAM; len++)
+    {
+      printf(" %6s%d%s", "len", len, len == GMAP_STATS_HISTOGRAM - 1 ? "+" : " ");
+    }
+  printf(" %7s %9s %10s %7s %9s %9s %9s %9s\n",
+	 "longest", "probe/hit", "probe/miss", "resizes", "resize-ms", "table-KB", "nodes-KB", "keys-KB");
+
+  for (size_t h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h++)
+    {
+      gmap *m = gmap_create_bytes(string_key_size, compare_keys, hashes[h].hash);
+      add_keys_with_values(m, keys, n, values);
+      for (size_t i = 0; i < n; i++)
+	{
+	  gmap_get(m, keys[i]);
+	  gmap_get(m, missing[i]);
+	}
+
+      gmap_stats stats;
+      gmap_get_stats(m, &stats);
+      printf("%-6s %6.3f %8zu", hashes[h].name, stats.load_factor, stats.buckets);
+      for (int len = 0; len < GMAP_STATS_HISTOGRAM; len++)
+	{
+	  printf(" %8zu", stats.histogram[len]);
+	}
+      printf(" %7zu %9.3f %10.3f %7zu %9.3f %9.1f %9.1f %9.1f\n",
+	     stats.longest,
+	     stats.hits > 0 ? (double)stats.hit_probes / stats.hits : 0.0,
+	     stats.misses > 0 ? (double)stats.miss_probes / stats.misses : 0.0,
+	     stats.resizes, stats.resize_seconds * 1e3,
+	     stats.table_bytes / 1024.0, stats.node_bytes / 1024.0, stats.key_bytes / 1024.0);
+
+      if (stats.size != n || stats.longest == 0 || stats.node_bytes == 0)
+	{
+	  passed = false;
+	}
+      gmap_destroy(m);
+    }
+
+  free_words(keys, n);
+  free_words(missing, n);
+  free(values);
+  if (passed)
+    {
+      PRINT_PASSED;
+    }
+  else
+    {
+      printf("FAILED -- inconsistent statistics\n");
+    }
+}
+
+
+void test_typed_map(size_t n)
+{
+  long_map *m = long_map_create();
+
+  for (long i = 0; i < (long)n; i++)
+    {
+      long_map_put(m, i, i * 2);
+    }
+  long_map_put(m, 0, -1);
+  if (long_map_size(m) != n || *long_map_get(m, 0) != -1 || long_map_get(m, (long)n) != NULL)
+    {
+      printf("FAILED -- typed map has wrong contents after puts\n");
+      goto destroy_map;
+    }
+
+  // remove the odd keys; the even ones must stay reachable
+  for (long i = 1; i < (long)n; i += 2)
+    {
+      long removed = 0;
+      if (!long_map_remove(m, i, &removed) || removed != i * 2)
+	{
+	  printf("FAILED -- could not remove %ld\n", i);
+	  goto destroy_map;
+	}
+    }
+  for (long i = 2; i < (long)n; i++)
+    {
+      long *value = long_map_get(m, i);
+      if ((i % 2 == 0) != (value != NULL) || (value != NULL && *value != i * 2))
+	{
+	  printf("FAILED -- wrong value for %ld after removals\n", i);
+	  goto destroy_map;
+	}
+    }
+  if (long_map_size(m) != (n + 1) / 2 || long_map_remove(m, 1, NULL))
+    {
+      printf("FAILED -- typed map has wrong size after removals\n");
+      goto destroy_map;
+    }
+
+  long_map_destroy(m);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  long_map_destroy(m);
+}
+
+
+void test_frozen(size_t n)
+{
+  gmap *m = gmap_create_bytes(string_key_size, compare_keys, hash_string_wy);
+  char **keys = make_words("word", n);
+  char **missing = make_words("miss", n);
+  int *values = malloc(sizeof(int) * n);
+  gmap_frozen *f = gmap_freeze(m, compare_keys, hash_string_wy);
+
+  // an empty map freezes too
+  if (f == NULL || gmap_frozen_size(f) != 0 || gmap_frozen_get(f, keys[0]) != NULL)
+    {
+      printf("FAILED -- could not freeze empty map\n");
+      goto destroy_map;
+    }
+  gmap_frozen_destroy(f);
+
+  add_keys_with_values(m, keys, n, values);
+  f = gmap_freeze(m, compare_keys, hash_string_wy);
+  if (f == NULL || gmap_frozen_size(f) != n)
+    {
+      printf("FAILED -- could not freeze map of %zu keys\n", n);
+      goto destroy_map;
+    }
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gmap_frozen_get(f, keys[i]) != values + i || gmap_frozen_contains_key(f, missing[i]))
+	{
+	  printf("FAILED -- incorrect frozen lookup for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  // a hash that cannot tell keys apart cannot be made perfect
+  gmap_frozen_destroy(f);
+  f = NULL;
+  if (gmap_freeze(m, compare_keys, hash_string_first) != NULL)
+    {
+      printf("FAILED -- froze map with colliding hash codes\n");
+      goto destroy_map;
+    }
+
+  gmap_destroy(m);
+  free_words(keys, n);
+  free_words(missing, n);
+  free(values);
+  PRINT_PASSED;
+  return;
+
+ destroy_map:
+  gmap_frozen_destroy(f);
+  gmap_destroy(m);
+  free_words(keys, n);
+  free_words(missing, n);
+  free(values);
+}
+
+
+void test_build_parallel(size_t n, size_t nthreads)
+{
+  // the second map's keys are too long to be kept in its nodes
+  gmap *maps[] = {gmap_create(duplicate, compare_keys, java_hash_string, free),
+		  gmap_create_bytes(string_key_size, compare_keys, hash_string_wy)};
+  char **words[] = {make_words("word", n),
+		    make_words("a-key-long-enough-to-need-its-own-copy-", n)};
+  size_t repeats = n / 4;
+  gmap_pair *pairs = malloc(sizeof(gmap_pair) * (n + repeats));
+  int *values = malloc(sizeof(int) * (n + repeats));
+
+  for (size_t k = 0; k < 2; k++)
+    {
+      // the first quarter of the keys come again with new values at the end
+      for (size_t i = 0; i < n + repeats; i++)
+	{
+	  pairs[i].key = words[k][i % n];
+	  pairs[i].value = values + i;
+	}
+
+      if (!gmap_build_parallel(maps[k], pairs, n + repeats, nthreads) || gmap_size(maps[k]) != n)
+	{
+	  printf("FAILED -- could not build map of %zu keys\n", n);
+	  goto destroy_maps;
+	}
+      for (size_t i = 0; i < n; i++)
+	{
+	  int *expected = values + (i < repeats ? n + i : i);
+	  if (gmap_get(maps[k], words[k][i]) != expected)
+	    {
+	      printf("FAILED -- incorrect value for key %s after parallel build\n", words[k][i]);
+	      goto destroy_maps;
+	    }
+	}
+
+      // nodes built by other threads can be removed and reused
+      for (size_t i = 0; i < n; i += 2)
+	gmap_remove(maps[k], words[k][i]);
+      add_keys_with_values(maps[k], words[k], n, values);
+      if (gmap_size(maps[k]) != n || gmap_get(maps[k], words[k][n - 1]) != values + n - 1)
+	{
+	  printf("FAILED -- incorrect map after changing built map\n");
+	  goto destroy_maps;
+	}
+
+      if (gmap_build_parallel(maps[k], pairs, n, nthreads))
+	{
+	  printf("FAILED -- built into a map that was not empty\n");
+	  goto destroy_maps;
+	}
+    }
+
+  PRINT_PASSED;
+
+ destroy_maps:
+  for (size_t k = 0; k < 2; k++)
+    {
+      gmap_destroy(maps[k]);
+      free_words(words[k], n);
+    }
+  free(pairs);
+  free(values);
+}
+
+
+void test_miss_filter(size_t n)
+{
+  gmap *m = gmap_create_bytes(string_key_size, compare_keys, java_hash_string);
+  char **keys = make_words("word", n);
+  char **missing = make_words("miss", n);
+  int *values = malloc(sizeof(int) * n);
+
+  // turned on while empty, so every put and resize after must keep it up to date
+  if (!gmap_set_miss_filter(m, true))
+    {
+      printf("FAILED -- could not add filter\n");
+      goto destroy_map;
+    }
+  gmap_set_incremental_resize(m, true);
+  add_keys_with_values(m, keys, n, values);
+  gmap_stats before;
+  gmap_get_stats(m, &before);
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gmap_get(m, keys[i]) != values + i || gmap_contains_key(m, missing[i]))
+	{
+	  printf("FAILED -- incorrect lookup with filter for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  // with the counters compiled in, most misses should not reach a chain
+  gmap_stats after;
+  gmap_get_stats(m, &after);
+  size_t miss_probes = after.miss_probes - before.miss_probes;
+  if (miss_probes * 10 > n)
+    {
+      printf("FAILED -- %zu chain nodes visited by misses with filter\n", miss_probes);
+      goto destroy_map;
+    }
+
+  // removed keys are gone even though their bits stay in the filter
+  for (size_t i = 0; i < n; i += 2)
+    {
+      gmap_remove(m, keys[i]);
+    }
+  gmap_shrink_to_fit(m);
+  for (size_t i = 0; i < n; i++)
+    {
+      if (gmap_contains_key(m, keys[i]) != (i % 2 == 1) || gmap_remove(m, missing[i]) != NULL)
+	{
+	  printf("FAILED -- incorrect lookup with filter after removing keys\n");
+	  goto destroy_map;
+	}
+    }
+
+  if (!gmap_set_miss_filter(m, false) || !gmap_contains_key(m, keys[1]) || gmap_contains_key(m, keys[0]))
+    {
+      printf("FAILED -- incorrect lookup after removing filter\n");
+      goto destroy_map;
+    }
+
+  PRINT_PASSED;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free_words(missing, n);
+  free(values);
+}
+
+
+void test_counter(size_t n)
+{
+  gmap *m = gmap_create_counter(string_key_size, compare_keys, hash_string_wy);
+  char **keys = make_words("word", n);
+  int64_t *count = NULL;
+
+  // key i is counted i + 1 times: a few ones, then the rest at once
+  for (size_t i = 0; i < n; i++)
+    {
+      for (size_t j = 0; j < i % 4; j++)
+	{
+	  count = gmap_increment(m, keys[i], 1);
+	}
+      count = gmap_increment(m, keys[i], (int64_t)(i + 1 - i % 4));
+      if (count == NULL || *count != (int64_t)(i + 1))
+	{
+	  printf("FAILED -- incorrect count for key %s\n", keys[i]);
+	  goto destroy_map;
+	}
+    }
+
+  // removing a key discards its count; it starts again from 0
+  if (gmap_remove(m, keys[0]) != NULL || gmap_contains_key(m, keys[0])
+      || gmap_put(m, keys[0], keys[0]) != gmap_error
+      || *gmap_increment(m, keys[0], -5) != -5)
+    {
+      printf("FAILED -- incorrect counter map after removing key %s\n", keys[0]);
+      goto destroy_map;
+    }
+
+  gmap_shrink_to_fit(m);
+  int64_t sum = 0;
+  gmap_for_each(m, gmap_unit_sum_counts, &sum);
+  int64_t expected = (int64_t)n * (int64_t)(n + 1) / 2 - 1 - 5;
+  count = gmap_get(m, keys[n - 1]);
+  if (sum != expected || gmap_size(m) != n || count == NULL || *count != (int64_t)n)
+    {
+      printf("FAILED -- counts sum to %lld instead of %lld\n", (long long)sum, (long long)expected);
+      goto destroy_map;
+    }
+
+  PRINT_PASSED;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+}
+
+
+void gmap_unit_sum_counts(const void *key, void *value, void *arg)
+{
+  *(int64_t *)arg += *(int64_t *)value;
+}
+
+
+void test_string_pool(size_t n)
+{
+  string_pool *p = string_pool_create();
+  char **keys = make_words("word", n);
+  char **again = make_words("word", n);
+  char *long_key = malloc(LONG_POOL_KEY_SIZE + 1);
+  memset(long_key, 'x', LONG_POOL_KEY_SIZE);
+  long_key[LONG_POOL_KEY_SIZE] = '\0';
+  const char **interned = malloc(sizeof(const char *) * n);
+  int *values = malloc(sizeof(int) * n);
+
+  // two maps sharing the pool's copies of the keys
+  gmap *m1 = gmap_create(copy_interned, compare_interned, hash_interned, free_interned);
+  gmap *m2 = gmap_create(copy_interned, compare_interned, hash_interned, free_interned);
+
+  for (size_t i = 0; i < n; i++)
+    {
+      interned[i] = string_pool_intern(p, keys[i]);
+      if (interned[i] == NULL || strcmp(interned[i], keys[i]) != 0 || hash_interned(interned[i]) != hash_string_wy(keys[i]))
+	{
+	  printf("FAILED -- could not intern %s\n", keys[i]);
+	  goto destroy_pool;
+	}
+      gmap_put(m1, interned[i], values + i);
+      gmap_put(m2, interned[i], values + n - 1 - i);
+    }
+
+  // equal strings intern to the same copy, which the maps find by address
+  const char *long_copy = string_pool_intern(p, long_key);
+  for (size_t i = 0; i < n; i++)
+    {
+      const char *same = string_pool_intern(p, again[i]);
+      if (same != interned[i] || string_pool_find(p, again[i]) != same
+	  || gmap_get(m1, same) != values + i || gmap_get(m2, same) != values + n - 1 - i)
+	{
+	  printf("FAILED -- incorrect lookup of interned %s\n", again[i]);
+	  goto destroy_pool;
+	}
+    }
+  if (long_copy == NULL || string_pool_intern(p, long_key) != long_copy
+      || string_pool_size(p) != n + 1 || string_pool_find(p, "missing") != NULL)
+    {
+      printf("FAILED -- incorrect pool of %zu strings\n", string_pool_size(p));
+      goto destroy_pool;
+    }
+
+  gmap_remove(m1, interned[0]);
+  if (gmap_contains_key(m1, interned[0]) || !gmap_contains_key(m2, interned[0]) || string_pool_find(p, keys[0]) != interned[0])
+    {
+      printf("FAILED -- removing from one map affected the pool or the other map\n");
+      goto destroy_pool;
+    }
+
+  PRINT_PASSED;
+
+ destroy_pool:
+  gmap_destroy(m1);
+  gmap_destroy(m2);
+  string_pool_destroy(p);
+  free_words(keys, n);
+  free_words(again, n);
+  free(long_key);
+  free(interned);
+  free(values);
+}
+
+
+// one thread's count of the pairs it visited and sum of their int values
+typedef struct _gmap_unit_tally_context
+{
+  size_t count;
+  long sum;
+} gmap_unit_tally_context;
+
+
+void gmap_unit_tally(const void *key, void *value, void *arg)
+{
+  gmap_unit_tally_context *tally = arg;
+  tally->count++;
+  tally->sum += *(int *)value;
+}
+
+
+void test_for_each_parallel(size_t n, size_t nthreads)
+{
+  gmap *m = gmap_create(duplicate, compare_keys, hash_string_wy, free);
+  char **keys = make_words("word", n);
+  int *values = malloc(sizeof(int) * n);
+  gmap_unit_tally_context *tallies = malloc(sizeof(gmap_unit_tally_context) * nthreads);
+  void **args = malloc(sizeof(void *) * nthreads);
+  for (size_t i = 0; i < n; i++)
+    {
+      values[i] = (int)i;
+    }
+  for (size_t t = 0; t < nthreads; t++)
+    {
+      args[t] = tallies + t;
+    }
+
+  // check at several sizes, some of them part way through a resize
+  gmap_set_incremental_resize(m, true);
+  size_t added = 0;
+  for (size_t step = 1; step <= 4; step++)
+    {
+      size_t target = n * step / 4;
+      add_keys_with_values(m, keys + added, target - added, values + added);
+      added = target;
+
+      for (size_t t = 0; t < nthreads; t++)
+	{
+	  tallies[t] = (gmap_unit_tally_context){0, 0};
+	}
+      gmap_for_each_parallel(m, gmap_unit_tally, args, nthreads);
+
+      gmap_unit_tally_context total = {0, 0};
+      for (size_t t = 0; t < nthreads; t++)
+	{
+	  total.count += tallies[t].count;
+	  total.sum += tallies[t].sum;
+	}
+      if (total.count != added || total.sum != (long)added * ((long)added - 1) / 2)
+	{
+	  printf("FAILED -- parallel for each over %zu keys visited %zu with sum %ld\n", added, total.count, total.sum);
+	  goto destroy_map;
+	}
+    }
+
+  PRINT_PASSED;
+
+ destroy_map:
+  gmap_destroy(m);
+  free_words(keys, n);
+  free(values);
+  free(tallies);
+  free(args);
+}
@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gmap.h"
+#include "gmap_test_functions.h"
+#include "string_key.h"
+
+/**
+ * Compares string hash functions on throughput and on how evenly they
+ * spread keys over the chains of a gmap-sized table.
+ *
+ * USAGE: HashBench [-seed n] [-n keys] [blotto-input-file ...]
+ *
+ * The distinct ids from the given Blotto input files (the part of each
+ * entry line before the first comma) form one key set; the others are
+ * synthetic.
+ * For each key set and hash function this prints the time per key, the
+ * throughput, the chain-length histogram and longest chain for a table
+ * with gmap's capacity sequence (101, 203, 407, ...) at load factor up
+ * to 1, and the average chain nodes visited per successful lookup.
+ */
+
+#define DEFAULT_KEYS 100000
+#define MAX_LINE 1024
+
+// total keys hashed per timing measurement
+#define HASHES_PER_TIMING 4000000
+
+// chains of this length or more share the last histogram column
+#define HISTOGRAM_WIDTH 5
+
+typedef struct _hash_function
+{
+  const char *name;
+  size_t (*hash)(const void *);
+} hash_function;
+
+typedef struct _key_set
+{
+  const char *name;
+  char **keys;
+  size_t n;
+} key_set;
+
+key_set read_ids(char **files, int nfiles);
+char **make_prefixed_words(const char *prefix, size_t len, size_t n);
+void report(const key_set *set, const hash_function *f);
+size_t gmap_capacity(size_t n);
+
+int main(int argc, char **argv)
+{
+  size_t n = DEFAULT_KEYS;
+  int first_file = 1;
+  while (first_file + 1 < argc && argv[first_file][0] == '-')
+    {
+      if (strcmp(argv[first_file], "-seed") == 0)
+	{
+	  string_hash_set_seed(strtoull(argv[first_file + 1], NULL, 0));
+	}
+      else if (strcmp(argv[first_file], "-n") == 0)
+	{
+	  n = strtoul(argv[first_file + 1], NULL, 0);
+	}
+      else
+	{
+	  fprintf(stderr, "USAGE: %s [-seed n] [-n keys] [blotto-input-file ...]\n", argv[0]);
+	  return 1;
+	}
+      first_file += 2;
+    }
+
+  hash_function functions[] = {
+    {"hash29", hash29},
+    {"java", java_hash_string},
+    {"sum", hash_string_sum},
+    {"first", hash_string_first},
+    {"wy", hash_string_wy},
+    {"xx", hash_string_xx},
+  };
+  size_t nfunctions = sizeof(functions) / sizeof(functions[0]);
+
+  int *sequence = malloc(sizeof(int) * n);
+  for (size_t i = 0; i < n; i++)
+    {
+      sequence[i] = (int)i;
+    }
+  key_set sets[] = {
+    read_ids(argv + first_file, argc - first_file),
+    {"sequential P<i>", make_words_concat("P", sequence, n), n},
+    {"random 10 chars", make_random_words(10, n), n},
+    {"31-char ids", make_prefixed_words("player-", 31, n), n},
+    {"80-char prefix", make_prefixed_words("a-long-common-prefix-shared-by-every-key-in-this-set-", 80, n), n},
+  };
+  size_t nsets = sizeof(sets) / sizeof(sets[0]);
+  free(sequence);
+
+  printf("%-16s %-7s %8s %9s %8s %8s %8s %8s %8s %6s %8s\n",
+	 "keys", "hash", "ns/key", "MB/s", "len0", "len1", "len2", "len3", "len4+", "max", "probes");
+  for (size_t s = 0; s < nsets; s++)
+    {
+      for (size_t f = 0; f < nfunctions && sets[s].n > 0; f++)
+	{
+	  report(&sets[s], &functions[f]);
+	}
+      free_words(sets[s].keys, sets[s].n);
+    }
+  return 0;
+}
+
+void report(const key_set *set, const hash_function *f)
+{
+  // throughput
+  size_t rounds = HASHES_PER_TIMING / set->n + 1;
+  size_t bytes = 0;
+  for (size_t i = 0; i < set->n; i++)
+    {
+      bytes += strlen(set->keys[i]);
+    }
+  volatile size_t sink = 0;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t r = 0; r < rounds; r++)
+    {
+      for (size_t i = 0; i < set->n; i++)
+	{
+	  sink += f->hash(set->keys[i]);
+	}
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  // chain lengths for a chained table the way gmap.c sizes and indexes it
+  size_t cap = gmap_capacity(set->n);
+  size_t *chains = calloc(cap, sizeof(size_t));
+  for (size_t i = 0; i < set->n; i++)
+    {
+      chains[f->hash(set->keys[i]) % cap]++;
+    }
+  size_t histogram[HISTOGRAM_WIDTH] = {0};
+  size_t longest = 0;
+  double probes = 0;
+  for (size_t c = 0; c < cap; c++)
+    {
+      size_t len = chains[c];
+      histogram[len < HISTOGRAM_WIDTH ? len : HISTOGRAM_WIDTH - 1]++;
+      if (len > longest)
+	{
+	  longest = len;
+	}
+      // finding each of the len keys visits 1, 2, ..., len nodes
+      probes += len * (len + 1) / 2.0;
+    }
+  free(chains);
+
+  printf("%-16s %-7s %8.2f %9.1f %8zu %8zu %8zu %8zu %8zu %6zu %8.3f\n",
+	 set->name, f->name,
+	 secs * 1e9 / (rounds * set->n), bytes * rounds / secs / 1e6,
+	 histogram[0], histogram[1], histogram[2], histogram[3], histogram[4],
+	 longest, probes / set->n);
+}
+
+size_t gmap_capacity(size_t n)
+{
+  // gmap.c starts at 101 chains and embiggens to 2 * cap + 1 when full
+  size_t cap = 101;
+  while (cap < n)
+    {
+      cap = cap * 2 + 1;
+    }
+  return cap;
+}
+
+key_set read_ids(char **files, int nfiles)
+{
+  key_set set = {"input ids", NULL, 0};
+  size_t capacity = 0;
+  char line[MAX_LINE];
+  // the same ids recur across files, and repeats would only pile up in
+  // chains of equal keys
+  gmap *seen = gmap_create(duplicate, compare_keys, hash_string_wy, free);
+
+  for (int i = 0; i < nfiles; i++)
+    {
+      FILE *in = fopen(files[i], "r");
+      if (in == NULL)
+	{
+	  fprintf(stderr, "could not open %s\n", files[i]);
+	  continue;
+	}
+
+      // entries run until the first line without a comma
+      while (fgets(line, MAX_LINE, in) != NULL && strchr(line, ',') != NULL)
+	{
+	  *strchr(line, ',') = '\0';
+	  if (gmap_contains_key(seen, line))
+	    {
+	      continue;
+	    }
+	  gmap_put(seen, line, NULL);
+	  if (set.n == capacity)
+	    {
+	      capacity = capacity * 2 + 1;
+	      set.keys = realloc(set.keys, sizeof(char *) * capacity);
+	    }
+	  set.keys[set.n] = malloc(strlen(line) + 1);
+	  strcpy(set.keys[set.n], line);
+	  set.n++;
+	}
+      fclose(in);
+    }
+  gmap_destroy(seen);
+  return set;
+}
+
+char **make_prefixed_words(const char *prefix, size_t len, size_t n)
+{
+  // the prefix padded with 'x' and ending in the index, len characters in all
+  char **arr = malloc(sizeof(char *) * n);
+  for (size_t i = 0; i < n; i++)
+    {
+      arr[i] = malloc(len + 1);
+      memset(arr[i], 'x', len);
+      arr[i][len] = '\0';
+      memcpy(arr[i], prefix, strlen(prefix) < len ? strlen(prefix) : len);
+
+      char digits[24];
+      size_t ndigits = sprintf(digits, "%zu", i);
+      memcpy(arr[i] + len - ndigits, digits, ndigits);
+    }
+  return arr;
+}
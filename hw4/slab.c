@@ -0,0 +1,162 @@
+/* CPSC223 Fall 2022 hw4
+ * A fixed-size object allocator used by gmap for nodes and short key copies.
+ */
+
+#include "slab.h"
+#include <stdlib.h>
+
+// objects in the first block; each later block is twice as large up to the max
+#define SLAB_FIRST_BLOCK 32
+#define SLAB_MAX_BLOCK 8192
+
+// space before the objects in a block, keeps objects 16-byte aligned
+#define SLAB_HEADER 16
+
+// objects are padded to a multiple of this
+#define SLAB_ALIGN sizeof(void *)
+
+// A block of objects; the objects follow the header in the same allocation
+typedef struct _slab_block
+{
+    struct _slab_block* next;
+} slab_block;
+
+// a freed object, linked through its first word
+typedef struct _slab_free_obj
+{
+    struct _slab_free_obj* next;
+} slab_free_obj;
+
+struct _slab
+{
+    // size of each object after padding
+    size_t obj_size;
+    // most recent block first
+    slab_block* blocks;
+    // number of objects in the most recent block
+    size_t block_objs;
+    // number of objects already carved from the most recent block
+    size_t used;
+    // objects returned by slab_free
+    slab_free_obj* free_list;
+    // total size of all blocks
+    size_t bytes;
+};
+
+slab *slab_create(size_t obj_size)
+{
+    if (obj_size == 0)
+        return NULL;
+
+    slab* s = malloc(sizeof(*s));
+    if (s != NULL)
+    {
+        // every object must be able to hold a free-list link
+        if (obj_size < sizeof(slab_free_obj))
+            obj_size = sizeof(slab_free_obj);
+        s->obj_size = (obj_size + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+        s->blocks = NULL;
+        s->block_objs = 0;
+        s->used = 0;
+        s->free_list = NULL;
+        s->bytes = 0;
+    }
+    return s;
+}
+
+void *slab_alloc(slab *s)
+{
+    if (s->free_list != NULL)
+    {
+        slab_free_obj* obj = s->free_list;
+        s->free_list = obj->next;
+        return obj;
+    }
+
+    if (s->blocks == NULL || s->used == s->block_objs)
+    {
+        // start a new block, twice as big as the last one
+        size_t nobjs = s->block_objs == 0 ? SLAB_FIRST_BLOCK : s->block_objs * 2;
+        if (nobjs > SLAB_MAX_BLOCK)
+            nobjs = SLAB_MAX_BLOCK;
+
+        size_t size = SLAB_HEADER + nobjs * s->obj_size;
+        slab_block* block = malloc(size);
+        if (block == NULL)
+            return NULL;
+        block->next = s->blocks;
+        s->blocks = block;
+        s->block_objs = nobjs;
+        s->used = 0;
+        s->bytes += size;
+    }
+
+    void* obj = (char *)s->blocks + SLAB_HEADER + s->used * s->obj_size;
+    s->used++;
+    return obj;
+}
+
+void slab_free(slab *s, void *obj)
+{
+    if (obj == NULL)
+        return;
+
+    slab_free_obj* freed = obj;
+    freed->next = s->free_list;
+    s->free_list = freed;
+}
+
+void slab_merge(slab *s, slab *other)
+{
+    if (other == NULL)
+        return;
+
+    if (s->blocks == NULL)
+    {
+        // carve from other's current block from now on
+        s->blocks = other->blocks;
+        s->block_objs = other->block_objs;
+        s->used = other->used;
+    }
+    else if (other->blocks != NULL)
+    {
+        // other's blocks go behind s's current block, which s keeps carving
+        slab_block* last = other->blocks;
+        while (last->next != NULL)
+            last = last->next;
+        last->next = s->blocks->next;
+        s->blocks->next = other->blocks;
+    }
+
+    if (other->free_list != NULL)
+    {
+        slab_free_obj* last = other->free_list;
+        while (last->next != NULL)
+            last = last->next;
+        last->next = s->free_list;
+        s->free_list = other->free_list;
+    }
+
+    s->bytes += other->bytes;
+    free(other);
+}
+
+size_t slab_bytes(const slab *s)
+{
+    return s == NULL ? 0 : s->bytes;
+}
+
+void slab_destroy(slab *s)
+{
+    if (s != NULL)
+    {
+        slab_block* curr = s->blocks;
+        while (curr != NULL)
+        {
+            slab_block* next = curr->next;
+            free(curr);
+            curr = next;
+        }
+        free(s);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdlib.h>
+
+/**
+ * A slab hands out fixed-size objects carved from large blocks.  Freed
+ * objects go on a free list and are reused before new space is carved.
+ * Destroying the slab releases every object at once, in time proportional
+ * to the number of blocks rather than the number of objects.
+ */
+typedef struct _slab slab;
+
+/**
+ * Creates an empty slab of objects of the given size.  Objects are aligned
+ * for any pointer or size_t member.
+ *
+ * @param obj_size a positive integer
+ * @return a pointer to the new slab, or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the slab
+ */
+slab *slab_create(size_t obj_size);
+
+/**
+ * Returns an uninitialized object from the given slab, or NULL if there
+ * was an allocation error.  The object is valid until it is passed to
+ * slab_free or the slab is destroyed.
+ *
+ * @param s a pointer to a slab, non-NULL
+ * @return a pointer to an object, or NULL
+ */
+void *slab_alloc(slab *s);
+
+/**
+ * Returns the given object to the slab it came from for reuse.
+ *
+ * @param s a pointer to a slab, non-NULL
+ * @param obj a pointer returned by slab_alloc on s, or NULL
+ */
+void slab_free(slab *s, void *obj);
+
+/**
+ * Moves every object of other, in use or free, into s and destroys other,
+ * so that objects allocated from other may be passed to slab_free on s.
+ * Both slabs must have been created with the same object size.
+ *
+ * @param s a pointer to a slab, non-NULL
+ * @param other a pointer to a slab, or NULL
+ */
+void slab_merge(slab *s, slab *other);
+
+/**
+ * Returns the number of bytes the given slab holds in blocks, whether the
+ * objects in them are in use or free.
+ *
+ * @param s a pointer to a slab, or NULL for 0
+ * @return the total size of the slab's blocks
+ */
+size_t slab_bytes(const slab *s);
+
+/**
+ * Destroys the given slab and every object allocated from it.  There is
+ * no effect if the given pointer is NULL.
+ *
+ * @param s a pointer to a slab, or NULL
+ */
+void slab_destroy(slab *s);
+
+#endif
@@ -1,7 +1,68 @@
 #include <string.h>
+#include <stdint.h>
 
 #include "string_key.h"
 
+// seed for hash_string_wy and hash_string_xx
+static uint64_t string_hash_seed = 0;
+
+// constants from wyhash
+#define WY_P0 0xa0761d6478bd642fULL
+#define WY_P1 0xe7037ed1a0b428dbULL
+#define WY_P2 0x8ebc6af09c88c6e3ULL
+
+// constants from xxHash64
+#define XX_P1 0x9E3779B185EBCA87ULL
+#define XX_P2 0xC2B2AE3D27D4EB4FULL
+#define XX_P3 0x165667B19E3779F9ULL
+
+/**
+ * Returns the 8 bytes at p as an integer, without alignment requirements.
+ */
+static inline uint64_t read64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * Returns the 4 bytes at p as an integer, without alignment requirements.
+ */
+static inline uint64_t read32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/**
+ * Returns the high and low halves of the 128-bit product of a and b,
+ * folded together with exclusive or.
+ */
+static inline uint64_t mum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 uint128;
+  uint128 r = (uint128)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+  uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t carry = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  carry += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+  return lo ^ hi;
+#endif
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
 size_t hash29(const void *key)
 {
   const char *s = key;
@@ -17,6 +78,88 @@ size_t hash29(const void *key)
   return sum;
 }
 
+size_t hash_string_wy(const void *key)
+{
+  const unsigned char *p = key;
+  size_t len = strlen(key);
+  uint64_t seed = string_hash_seed ^ mum(string_hash_seed ^ WY_P0, WY_P1);
+  uint64_t a, b;
+
+  if (len <= 16)
+    {
+      if (len >= 4)
+	{
+	  // two overlapping reads cover 4 to 16 bytes
+	  size_t mid = (len >> 3) << 2;
+	  a = (read32(p) << 32) | read32(p + mid);
+	  b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+	}
+      else if (len > 0)
+	{
+	  a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+	  b = 0;
+	}
+      else
+	{
+	  a = b = 0;
+	}
+    }
+  else
+    {
+      size_t i = len;
+      while (i > 16)
+	{
+	  seed = mum(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+	  p += 16;
+	  i -= 16;
+	}
+      // the last 16 bytes, overlapping what was already read
+      a = read64(p + i - 16);
+      b = read64(p + i - 8);
+    }
+
+  return mum(WY_P1 ^ len, mum(a ^ WY_P1, b ^ seed) ^ WY_P2);
+}
+
+size_t hash_string_xx(const void *key)
+{
+  const unsigned char *p = key;
+  size_t len = strlen(key);
+  const unsigned char *end = p + len;
+  uint64_t h = string_hash_seed + XX_P3 + len;
+
+  while (p + 8 <= end)
+    {
+      uint64_t k = read64(p) * XX_P2;
+      k = rotl64(k, 31) * XX_P1;
+      h = rotl64(h ^ k, 27) * XX_P1 + XX_P3;
+      p += 8;
+    }
+  if (p + 4 <= end)
+    {
+      h = rotl64(h ^ (read32(p) * XX_P1), 23) * XX_P2 + XX_P3;
+      p += 4;
+    }
+  while (p < end)
+    {
+      h = rotl64(h ^ (*p * XX_P3), 11) * XX_P1;
+      p++;
+    }
+
+  // avalanche
+  h ^= h >> 33;
+  h *= XX_P2;
+  h ^= h >> 29;
+  h *= XX_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+void string_hash_set_seed(size_t seed)
+{
+  string_hash_seed = seed;
+}
+
 void *duplicate(const void *key)
 {
   char *s = malloc(strlen(key) + 1);
@@ -27,6 +170,21 @@ void *duplicate(const void *key)
   return s;
 }
 
+size_t string_key_size(const void *key)
+{
+  return strlen(key) + 1;
+}
+
+size_t string_key_write(const void *key, void *dest)
+{
+  size_t size = strlen(key) + 1;
+  if (dest != NULL)
+    {
+      memcpy(dest, key, size);
+    }
+  return size;
+}
+
 int compare_keys(const void *key1, const void *key2)
 {
   return strcmp(key1, key2);
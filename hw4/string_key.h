@@ -11,6 +11,36 @@
  */
 size_t hash29(const void *key);
 
+/**
+ * A wyhash-style hash function for strings.  Reads 16 bytes per step and
+ * mixes with 64x64->128-bit multiplies, so every output bit depends on
+ * every input byte.  Uses the seed set by string_hash_set_seed.
+ *
+ * @param key a pointer to a string, non-NULL
+ * @return the hash code of the string
+ */
+size_t hash_string_wy(const void *key);
+
+/**
+ * An xxHash-style hash function for strings.  Reads 8 bytes per step
+ * into a multiply-rotate accumulator and finishes with an avalanche
+ * step.  Uses the seed set by string_hash_set_seed.
+ *
+ * @param key a pointer to a string, non-NULL
+ * @return the hash code of the string
+ */
+size_t hash_string_xx(const void *key);
+
+/**
+ * Sets the seed used by hash_string_wy and hash_string_xx.  A seed chosen
+ * at random when the program starts makes it impractical for input to be
+ * crafted so that many keys collide.  Changing the seed changes every hash
+ * code, so it must not change while a map using these functions holds keys.
+ *
+ * @param seed any value; the default is 0
+ */
+void string_hash_set_seed(size_t seed);
+
 /**
  * Makes a copy of the given string.  Returns NULL if there is an allocation
  * error for the copy.  It is the caller's responsibility to free the returned
@@ -21,6 +51,25 @@ size_t hash29(const void *key);
  */
 void *duplicate(const void *key);
 
+/**
+ * Returns the number of bytes in the given string including its null
+ * terminator, for use with gmap_create_bytes.
+ *
+ * @param key a pointer to a string, non-NULL
+ * @return the size of the string in bytes
+ */
+size_t string_key_size(const void *key);
+
+/**
+ * Serializes the given string for gmap_save: writes its characters and
+ * null terminator to dest if dest is non-NULL.
+ *
+ * @param key a pointer to a string, non-NULL
+ * @param dest a pointer to at least string_key_size(key) bytes, or NULL
+ * @return the size of the serialized string in bytes
+ */
+size_t string_key_write(const void *key, void *dest);
+
 /**
  * Compares the two strings.  The return value is negative if the first
  * one comes first by a character-by-character ASCII code comparison,
@@ -0,0 +1,249 @@
+/* CPSC223 Fall 2022 hw4
+ * A pool of interned strings, each stored once with its hash code in
+ * front of it, indexed by an open-addressed table.
+ */
+
+#include "string_pool.h"
+#include "string_key.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// must be a power of two
+#define STRING_POOL_INITIAL_CAPACITY 64
+
+// bytes of string copies carved from each block; longer strings get a
+// block of their own
+#define STRING_POOL_BLOCK 16384
+
+// an interned string: its hash code, then its characters
+typedef struct _string_pool_entry
+{
+    size_t hash;
+    char s[];
+} string_pool_entry;
+
+// the entry holding interned string str
+#define STRING_POOL_ENTRY(str) ((const string_pool_entry*)((const char*)(str) - offsetof(string_pool_entry, s)))
+
+// a slot of the table; the hash is repeated so most probes stay in the table
+typedef struct _string_pool_slot
+{
+    size_t hash;
+    string_pool_entry* entry;
+} string_pool_slot;
+
+// a block of entries; the entries follow the header in the same allocation
+typedef struct _string_pool_block
+{
+    struct _string_pool_block* next;
+    // bytes of entries the block holds
+    size_t size;
+} string_pool_block;
+
+struct _string_pool
+{
+    // open addressing with linear probing; a NULL entry is an empty slot
+    string_pool_slot* table;
+    // number of slots (power of two), kept at least twice the strings
+    size_t cap;
+    // number of strings
+    size_t n;
+    // blocks of entries, the one being carved first
+    string_pool_block* blocks;
+    // bytes already carved from the first block
+    size_t used;
+    // total size of all blocks
+    size_t bytes;
+};
+
+// helper function declarations
+static size_t string_pool_index(const string_pool* p, const char* s, size_t hash);
+static string_pool_entry* string_pool_alloc(string_pool* p, size_t size);
+static bool string_pool_grow(string_pool* p);
+
+string_pool *string_pool_create(void)
+{
+    string_pool* p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        return NULL;
+
+    p->table = calloc(STRING_POOL_INITIAL_CAPACITY, sizeof(string_pool_slot));
+    if (p->table == NULL)
+    {
+        free(p);
+        return NULL;
+    }
+    p->cap = STRING_POOL_INITIAL_CAPACITY;
+    return p;
+}
+
+const char *string_pool_intern(string_pool *p, const char *s)
+{
+    if (p == NULL || s == NULL)
+        return NULL;
+
+    size_t hash = hash_string_wy(s);
+    size_t i = string_pool_index(p, s, hash);
+    if (p->table[i].entry != NULL)
+        return p->table[i].entry->s;
+
+    // keep at most half the slots full so misses end quickly
+    if ((p->n + 1) * 2 > p->cap)
+    {
+        if (!string_pool_grow(p))
+            return NULL;
+        i = string_pool_index(p, s, hash);
+    }
+
+    size_t len = strlen(s) + 1;
+    string_pool_entry* entry = string_pool_alloc(p, sizeof(string_pool_entry) + len);
+    if (entry == NULL)
+        return NULL;
+    entry->hash = hash;
+    memcpy(entry->s, s, len);
+
+    p->table[i].hash = hash;
+    p->table[i].entry = entry;
+    p->n++;
+    return entry->s;
+}
+
+const char *string_pool_find(const string_pool *p, const char *s)
+{
+    if (p == NULL || s == NULL)
+        return NULL;
+
+    string_pool_entry* entry = p->table[string_pool_index(p, s, hash_string_wy(s))].entry;
+    return entry == NULL ? NULL : entry->s;
+}
+
+size_t string_pool_size(const string_pool *p)
+{
+    return p == NULL ? 0 : p->n;
+}
+
+size_t string_pool_bytes(const string_pool *p)
+{
+    return p == NULL ? 0 : sizeof(*p) + p->cap * sizeof(string_pool_slot) + p->bytes;
+}
+
+void string_pool_destroy(string_pool *p)
+{
+    if (p != NULL)
+    {
+        string_pool_block* curr = p->blocks;
+        while (curr != NULL)
+        {
+            string_pool_block* next = curr->next;
+            free(curr);
+            curr = next;
+        }
+        free(p->table);
+        free(p);
+    }
+}
+
+size_t hash_interned(const void *key)
+{
+    return STRING_POOL_ENTRY(key)->hash;
+}
+
+int compare_interned(const void *key1, const void *key2)
+{
+    uintptr_t a = (uintptr_t)key1;
+    uintptr_t b = (uintptr_t)key2;
+    return (a > b) - (a < b);
+}
+
+void *copy_interned(const void *key)
+{
+    return (void*)key;
+}
+
+void free_interned(void *key)
+{
+    // the pool owns every interned string
+    (void)key;
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+
+/*
+ * Returns the index of the slot holding s, or of the empty slot where it
+ * would go.
+ */
+static size_t string_pool_index(const string_pool* p, const char* s, size_t hash)
+{
+    size_t mask = p->cap - 1;
+    size_t i = hash & mask;
+    while (p->table[i].entry != NULL
+           && (p->table[i].hash != hash || strcmp(p->table[i].entry->s, s) != 0))
+        i = (i + 1) & mask;
+    return i;
+}
+
+/*
+ * Returns space for an entry of the given size, aligned for its hash
+ * code, or NULL if there was an allocation error.
+ */
+static string_pool_entry* string_pool_alloc(string_pool* p, size_t size)
+{
+    size = (size + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+
+    if (p->blocks == NULL || p->used + size > p->blocks->size)
+    {
+        size_t block_size = size > STRING_POOL_BLOCK ? size : STRING_POOL_BLOCK;
+        string_pool_block* block = malloc(sizeof(string_pool_block) + block_size);
+        if (block == NULL)
+            return NULL;
+        block->size = block_size;
+        p->bytes += sizeof(string_pool_block) + block_size;
+
+        if (p->blocks != NULL && block_size == size)
+        {
+            // a string with a block of its own goes behind the current block
+            block->next = p->blocks->next;
+            p->blocks->next = block;
+            return (string_pool_entry*)(block + 1);
+        }
+        block->next = p->blocks;
+        p->blocks = block;
+        p->used = 0;
+    }
+
+    string_pool_entry* entry = (string_pool_entry*)((char*)(p->blocks + 1) + p->used);
+    p->used += size;
+    return entry;
+}
+
+/*
+ * Doubles the table.  Returns false, leaving the pool as it was, if the
+ * new table could not be allocated.
+ */
+static bool string_pool_grow(string_pool* p)
+{
+    size_t newcap = p->cap * 2;
+    string_pool_slot* newtable = calloc(newcap, sizeof(string_pool_slot));
+    if (newtable == NULL)
+        return false;
+
+    for (size_t j = 0; j < p->cap; j++)
+    {
+        if (p->table[j].entry != NULL)
+        {
+            size_t i = p->table[j].hash & (newcap - 1);
+            while (newtable[i].entry != NULL)
+                i = (i + 1) & (newcap - 1);
+            newtable[i] = p->table[j];
+        }
+    }
+
+    free(p->table);
+    p->table = newtable;
+    p->cap = newcap;
+    return true;
+}
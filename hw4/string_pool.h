@@ -0,0 +1,115 @@
+#ifndef __STRING_POOL_H__
+#define __STRING_POOL_H__
+
+#include <stdlib.h>
+
+/**
+ * A pool of interned strings.  Interning a string returns the pool's one
+ * copy of it, so equal strings interned in the same pool are the same
+ * pointer, and each copy carries its hash code (from hash_string_wy).
+ * Maps whose keys are interned strings can share the pool's copies
+ * instead of making their own, compare keys by pointer, and read hash
+ * codes instead of computing them: create them with
+ *
+ *   gmap_create(copy_interned, compare_interned, hash_interned, free_interned)
+ *
+ * and pass only strings returned by string_pool_intern or
+ * string_pool_find as keys.  The pool must outlive every such map, and
+ * the hash seed must not change while the pool holds strings.  A pool is
+ * not safe to change from several threads at once.
+ */
+struct _string_pool;
+typedef struct _string_pool string_pool;
+
+/**
+ * Creates an empty pool.
+ *
+ * @return a pointer to the new pool, or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the pool
+ */
+string_pool *string_pool_create(void);
+
+/**
+ * Returns the pool's copy of the given string, first adding a copy if
+ * the pool has none.  The copy is valid until the pool is destroyed.
+ *
+ * @param p a pointer to a pool, non-NULL
+ * @param s a pointer to a string, non-NULL
+ * @return a pointer to the pool's copy of s, or NULL if there was an
+ * allocation error
+ */
+const char *string_pool_intern(string_pool *p, const char *s);
+
+/**
+ * Returns the pool's copy of the given string, or NULL if the pool has
+ * none.  A string that was never interned cannot be a key in a map of
+ * interned strings, so this answers lookups without adding to the pool.
+ *
+ * @param p a pointer to a pool, non-NULL
+ * @param s a pointer to a string, non-NULL
+ * @return a pointer to the pool's copy of s, or NULL
+ */
+const char *string_pool_find(const string_pool *p, const char *s);
+
+/**
+ * Returns the number of distinct strings in the given pool.
+ *
+ * @param p a pointer to a pool, non-NULL
+ * @return the number of strings interned in p
+ */
+size_t string_pool_size(const string_pool *p);
+
+/**
+ * Returns the number of bytes the given pool holds for its table and its
+ * copies of strings.
+ *
+ * @param p a pointer to a pool, non-NULL
+ * @return the memory used by p
+ */
+size_t string_pool_bytes(const string_pool *p);
+
+/**
+ * Destroys the given pool and every copy of a string in it.  There is no
+ * effect if the given pointer is NULL.
+ *
+ * @param p a pointer to a pool, or NULL
+ */
+void string_pool_destroy(string_pool *p);
+
+/**
+ * Returns the hash code stored with the given interned string.
+ *
+ * @param key a pointer to a string returned by string_pool_intern, non-NULL
+ * @return the string's hash code, as from hash_string_wy
+ */
+size_t hash_interned(const void *key);
+
+/**
+ * Compares two interned strings by address: the return value is 0 if
+ * they are equal and nonzero otherwise.  The order of unequal strings
+ * is consistent but not alphabetical.
+ *
+ * @param key1 a pointer to a string returned by string_pool_intern, non-NULL
+ * @param key2 a pointer to a string returned by string_pool_intern, non-NULL
+ * @return 0 if the strings are equal, or a positive or negative integer
+ */
+int compare_interned(const void *key1, const void *key2);
+
+/**
+ * Returns the given interned string itself, which the pool keeps alive,
+ * for use as a map's copy function.
+ *
+ * @param key a pointer to a string returned by string_pool_intern, non-NULL
+ * @return key
+ */
+void *copy_interned(const void *key);
+
+/**
+ * Does nothing, for use as the free function of a map whose copy
+ * function is copy_interned; the pool frees its strings when destroyed.
+ *
+ * @param key a pointer to a string returned by string_pool_intern
+ */
+void free_interned(void *key);
+
+#endif
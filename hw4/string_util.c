@@ -1,8 +1,35 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "string_util.h"
 
+// bytes read at a time from input that cannot be mapped
+#define LINE_READER_BLOCK 65536
+
+struct _line_reader
+{
+  int fd;
+  // the whole file if it is mapped, otherwise a window of the input
+  char *buf;
+  // bytes in buf, and the index of the first unread one
+  size_t size;
+  size_t pos;
+  // bytes buf can hold when reading blocks
+  size_t cap;
+  // length of the mapping, or 0 if buf is allocated
+  size_t mapped;
+  bool eof;
+};
+
 void read_line(char s[], int max)
 {
   int count = 0; // number of chars read
@@ -16,4 +43,129 @@ void read_line(char s[], int max)
       count++;
     }
   s[(count > max ? max : count)] = '\0';
-}
\ No newline at end of file
+}
+
+line_reader *line_reader_create(int fd)
+{
+  line_reader *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    {
+      return NULL;
+    }
+  r->fd = fd;
+
+  // a regular file is mapped whole, starting wherever the descriptor is
+  struct stat st;
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset)
+    {
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+	{
+	  posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	  r->buf = map;
+	  r->size = st.st_size;
+	  r->pos = offset;
+	  r->mapped = st.st_size;
+	  r->eof = true;
+	  return r;
+	}
+    }
+
+  r->buf = malloc(LINE_READER_BLOCK);
+  if (r->buf == NULL)
+    {
+      free(r);
+      return NULL;
+    }
+  r->cap = LINE_READER_BLOCK;
+  return r;
+}
+
+const char *line_reader_peek(line_reader *r, size_t *len)
+{
+  // bytes after pos already searched for a newline
+  size_t searched = 0;
+  const char *newline;
+  while ((newline = memchr(r->buf + r->pos + searched, '\n', r->size - r->pos - searched)) == NULL && !r->eof)
+    {
+      // move the partial line to the front and read more behind it
+      searched = r->size - r->pos;
+      memmove(r->buf, r->buf + r->pos, searched);
+      r->size = searched;
+      r->pos = 0;
+      if (r->size == r->cap)
+	{
+	  char *bigger = realloc(r->buf, r->cap * 2);
+	  if (bigger == NULL)
+	    {
+	      *len = 0;
+	      return NULL;
+	    }
+	  r->buf = bigger;
+	  r->cap *= 2;
+	}
+
+      ssize_t got;
+      do
+	{
+	  got = read(r->fd, r->buf + r->size, r->cap - r->size);
+	}
+      while (got < 0 && errno == EINTR);
+      if (got <= 0)
+	{
+	  r->eof = true;
+	}
+      else
+	{
+	  r->size += got;
+	}
+    }
+
+  *len = newline == NULL ? r->size - r->pos : (size_t)(newline - (r->buf + r->pos)) + 1;
+  return r->buf + r->pos;
+}
+
+bool line_reader_ready(const line_reader *r)
+{
+  return r->eof || memchr(r->buf + r->pos, '\n', r->size - r->pos) != NULL;
+}
+
+void line_reader_advance(line_reader *r, size_t n)
+{
+  r->pos += n;
+}
+
+void line_reader_read(line_reader *r, char s[], int max)
+{
+  size_t len;
+  const char *line = line_reader_peek(r, &len);
+  size_t consumed = len;
+  if (len > 0 && line[len - 1] == '\n')
+    {
+      len--;
+    }
+  size_t count = len < (size_t)max ? len : (size_t)max;
+  if (count > 0)
+    {
+      memcpy(s, line, count);
+    }
+  s[count] = '\0';
+  line_reader_advance(r, consumed);
+}
+
+void line_reader_destroy(line_reader *r)
+{
+  if (r != NULL)
+    {
+      if (r->mapped > 0)
+	{
+	  munmap(r->buf, r->mapped);
+	}
+      else
+	{
+	  free(r->buf);
+	}
+      free(r);
+    }
+}
@@ -1,6 +1,9 @@
 #ifndef __STRING_UTIL_H__
 #define __STRING_UTIL_H__
 
+#include <stdlib.h>
+#include <stdbool.h>
+
 /**
  * Reads from standard input until end of line or file, saving up
  * to the given number of characters in the given string.  The string
@@ -11,4 +14,76 @@
  */
 void read_line(char s[], int max);
 
+/**
+ * A reader of lines from a file descriptor.  A regular file is mapped
+ * into memory whole; other input (pipes, terminals) is read in large
+ * blocks.  Either way the reader hands out lines in place, so finding
+ * one costs a memchr for its newline and no copying.
+ */
+struct _line_reader;
+typedef struct _line_reader line_reader;
+
+/**
+ * Creates a reader of the given file descriptor, starting at its current
+ * offset.  The reader does not close the descriptor.  Nothing else should
+ * read from the descriptor (or a FILE on it) while the reader is in use.
+ *
+ * @param fd a file descriptor open for reading
+ * @return a pointer to the new reader, or NULL if it could not be created;
+ * it is the caller's responsibility to destroy the reader
+ */
+line_reader *line_reader_create(int fd);
+
+/**
+ * Returns a pointer to the next line of input without consuming it, and
+ * stores its length in len.  The line runs up to and including the next
+ * newline, or to the end of input if there is none, and is not
+ * null-terminated.  The length is 0 at end of input.  The line stays
+ * valid until the reader is advanced or destroyed.  Read errors are
+ * treated as the end of input.
+ *
+ * @param r a pointer to a reader, non-NULL
+ * @param len a pointer to where to store the length of the line, non-NULL
+ * @return a pointer to the line, or NULL if there was an allocation error
+ * for a line longer than the reader's buffer
+ */
+const char *line_reader_peek(line_reader *r, size_t *len);
+
+/**
+ * Determines whether the next line can be returned without reading more
+ * input, so that line_reader_peek and line_reader_read will not block.
+ *
+ * @param r a pointer to a reader, non-NULL
+ * @return true if a whole line is buffered or the input has ended
+ */
+bool line_reader_ready(const line_reader *r);
+
+/**
+ * Consumes the given number of characters of input.
+ *
+ * @param r a pointer to a reader, non-NULL
+ * @param n at most the length last returned by line_reader_peek
+ */
+void line_reader_advance(line_reader *r, size_t n);
+
+/**
+ * Reads the next line from the given reader as read_line does from
+ * standard input: up to the given number of characters are saved in the
+ * given string, which will be null-terminated, and the newline is
+ * neither saved nor left unread.
+ *
+ * @param r a pointer to a reader, non-NULL
+ * @param s a string with space to hold max+1 characters
+ * @param max a nonnegative integer
+ */
+void line_reader_read(line_reader *r, char s[], int max);
+
+/**
+ * Destroys the given reader.  There is no effect if the given pointer is
+ * NULL.
+ *
+ * @param r a pointer to a reader, or NULL
+ */
+void line_reader_destroy(line_reader *r);
+
 #endif
\ No newline at end of file
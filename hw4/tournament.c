@@ -0,0 +1,324 @@
+/* CPSC223 Fall 2022 hw4
+ * Round-robin Blotto tournaments: every pair of entries scored once, in
+ * cache-sized tiles of the distribution matrix, over several threads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "tournament.h"
+#include "blotto_score.h"
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TOURNAMENT_AVX2
+#include <immintrin.h>
+#endif
+
+// bytes of distributions in a tile; two tiles are played against each
+// other at a time, so this is about half of a first-level data cache
+#define TOURNAMENT_TILE_BYTES 16384
+
+// fewest entries in a tile
+#define TOURNAMENT_MIN_TILE 8
+
+// the work shared by the threads of one tournament
+typedef struct _tournament
+{
+    const int* distributions;
+    size_t n;
+    const int* weights;
+    int battlefields;
+    int64_t total_weight;
+    // entries per tile and number of tiles
+    size_t tile;
+    size_t ntiles;
+    // the next row of tiles to be claimed
+    size_t next_row;
+    // whether every margin summed over a tile fits in 32 bits
+    bool narrow;
+} tournament;
+
+// one thread's share: its own standings, so no updates are shared, and
+// room to play a tile eight opponents at a time
+typedef struct _tournament_worker
+{
+    tournament* t;
+    tournament_standing* standings;
+    // the second tile's counts, battlefield by battlefield
+    int* columns;
+    // the second tile's margin sums, wins and losses
+    int32_t* sums;
+    int32_t* wins;
+    int32_t* losses;
+} tournament_worker;
+
+// helper function declarations
+static void* tournament_play(void* arg);
+static void tournament_play_tiles(tournament* t, size_t first, size_t second, tournament_standing* standings);
+#ifdef TOURNAMENT_AVX2
+static void tournament_play_tiles_avx2(tournament_worker* w, size_t first, size_t second);
+#endif
+static int tournament_compare(const void* a, const void* b);
+
+bool tournament_run(const int *distributions, size_t n, const int *weights, int battlefields,
+                    size_t nthreads, tournament_standing *standings)
+{
+    tournament t = {distributions, n, weights, battlefields, 0, 0, 0, 0, false};
+    int64_t abs_weight = 0;
+    for (int f = 0; f < battlefields; f++)
+    {
+        t.total_weight += weights[f];
+        abs_weight += weights[f] < 0 ? -(int64_t)weights[f] : weights[f];
+    }
+    t.tile = TOURNAMENT_TILE_BYTES / (battlefields * sizeof(int));
+    if (t.tile < TOURNAMENT_MIN_TILE)
+        t.tile = TOURNAMENT_MIN_TILE;
+    t.ntiles = (n + t.tile - 1) / t.tile;
+    t.narrow = abs_weight * (int64_t)t.tile <= INT32_MAX;
+
+    // the workers live on the stack, so there are never more than processors
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t most = online > 0 ? (size_t)online : 1;
+    if (nthreads == 0 || nthreads > most)
+        nthreads = most;
+    if (nthreads > t.ntiles)
+        nthreads = t.ntiles > 0 ? t.ntiles : 1;
+
+    // the calling thread fills in the given standings; the others get their
+    // own; each thread has a tile's worth of columns and sums, the tile
+    // rounded up to whole groups of eight
+    size_t padded = (t.tile + 7) / 8 * 8;
+    size_t scratch_ints = padded * (battlefields + 3);
+    tournament_worker workers[nthreads];
+    tournament_standing* others = calloc((nthreads - 1) * n + 1, sizeof(tournament_standing));
+    int* scratch = malloc(nthreads * scratch_ints * sizeof(int));
+    if (others == NULL || scratch == NULL)
+    {
+        free(others);
+        free(scratch);
+        return false;
+    }
+    memset(standings, 0, n * sizeof(tournament_standing));
+    for (size_t w = 0; w < nthreads; w++)
+    {
+        int* mine = scratch + w * scratch_ints;
+        workers[w] = (tournament_worker){&t, w == 0 ? standings : others + (w - 1) * n,
+                                         mine, mine + padded * battlefields,
+                                         mine + padded * (battlefields + 1), mine + padded * (battlefields + 2)};
+    }
+
+    pthread_t threads[nthreads];
+    bool started[nthreads];
+    for (size_t w = 1; w < nthreads; w++)
+        started[w] = pthread_create(&threads[w], NULL, tournament_play, &workers[w]) == 0;
+    tournament_play(&workers[0]);
+    for (size_t w = 1; w < nthreads; w++)
+    {
+        // a worker whose thread did not start finds every row claimed
+        if (started[w])
+            pthread_join(threads[w], NULL);
+    }
+
+    // while playing, points2 holds the sum of the entry's margins
+    for (size_t i = 0; i < n; i++)
+    {
+        tournament_standing* s = &standings[i];
+        for (size_t w = 1; w < nthreads; w++)
+        {
+            s->wins += workers[w].standings[i].wins;
+            s->losses += workers[w].standings[i].losses;
+            s->points2 += workers[w].standings[i].points2;
+        }
+        s->entry = i;
+        s->ties = n - 1 - s->wins - s->losses;
+        s->points2 += (int64_t)(n - 1) * t.total_weight;
+    }
+    free(others);
+    free(scratch);
+    return true;
+}
+
+void tournament_rank(tournament_standing *standings, size_t n)
+{
+    qsort(standings, n, sizeof(tournament_standing), tournament_compare);
+}
+
+// =================================================================================================================
+// Helper Function Implementations
+// =================================================================================================================
+
+/*
+ * Claims rows of tiles until none are left, playing each tile in the row
+ * against itself and every later tile.  The rows near the start have the
+ * most tiles, so claiming them in order leaves the short rows to balance
+ * the threads at the end.
+ */
+static void* tournament_play(void* arg)
+{
+    tournament_worker* w = arg;
+    tournament* t = w->t;
+    size_t row;
+    while ((row = __atomic_fetch_add(&t->next_row, 1, __ATOMIC_RELAXED)) < t->ntiles)
+    {
+        for (size_t col = row; col < t->ntiles; col++)
+        {
+#ifdef TOURNAMENT_AVX2
+            if (t->narrow && __builtin_cpu_supports("avx2"))
+            {
+                tournament_play_tiles_avx2(w, row, col);
+                continue;
+            }
+#endif
+            tournament_play_tiles(t, row, col, w->standings);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Plays each entry in the first tile against each entry in the second,
+ * or each pair within the tile once if they are the same tile, adding
+ * margins to points2 and counting wins and losses; ties are what is left.
+ */
+static void tournament_play_tiles(tournament* t, size_t first, size_t second, tournament_standing* standings)
+{
+    size_t i_end = (first + 1) * t->tile < t->n ? (first + 1) * t->tile : t->n;
+    size_t j_end = (second + 1) * t->tile < t->n ? (second + 1) * t->tile : t->n;
+    for (size_t i = first * t->tile; i < i_end; i++)
+    {
+        const int* di = t->distributions + i * t->battlefields;
+        tournament_standing* si = &standings[i];
+        for (size_t j = first == second ? i + 1 : second * t->tile; j < j_end; j++)
+        {
+            int64_t margin = blotto_margin(di, t->distributions + j * t->battlefields, t->weights, t->battlefields);
+            tournament_standing* sj = &standings[j];
+            si->points2 += margin;
+            sj->points2 -= margin;
+            if (margin > 0)
+            {
+                si->wins++;
+                sj->losses++;
+            }
+            else if (margin < 0)
+            {
+                si->losses++;
+                sj->wins++;
+            }
+        }
+    }
+}
+
+#ifdef TOURNAMENT_AVX2
+/*
+ * Plays the tiles as tournament_play_tiles does, each entry of the first
+ * tile against eight entries of the second at a time.  The second tile is
+ * first transposed so that each battlefield's counts for eight opponents
+ * are one load.  Margins are summed in 32-bit lanes, which the caller has
+ * checked cannot overflow.
+ */
+__attribute__((target("avx2")))
+static void tournament_play_tiles_avx2(tournament_worker* w, size_t first, size_t second)
+{
+    tournament* t = w->t;
+    size_t battlefields = t->battlefields;
+    size_t i_start = first * t->tile;
+    size_t i_end = i_start + t->tile < t->n ? i_start + t->tile : t->n;
+    size_t j_start = second * t->tile;
+    size_t nj = j_start + t->tile < t->n ? t->tile : t->n - j_start;
+    size_t stride = (nj + 7) / 8 * 8;
+
+    for (size_t f = 0; f < battlefields; f++)
+    {
+        for (size_t j = 0; j < stride; j++)
+            w->columns[f * stride + j] = j < nj ? t->distributions[(j_start + j) * battlefields + f] : 0;
+    }
+    memset(w->sums, 0, stride * sizeof(int32_t));
+    memset(w->wins, 0, stride * sizeof(int32_t));
+    memset(w->losses, 0, stride * sizeof(int32_t));
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i end = _mm256_set1_epi32((int)nj);
+    for (size_t i = i_start; i < i_end; i++)
+    {
+        const int* di = t->distributions + i * battlefields;
+        // within one tile only the opponents after i are played
+        size_t from = first == second ? i - i_start + 1 : 0;
+        const __m256i before = _mm256_set1_epi32((int)from - 1);
+        __m256i sum = zero;
+        __m256i wins = zero;
+        __m256i losses = zero;
+        for (size_t j = from / 8 * 8; j < stride; j += 8)
+        {
+            __m256i margin = zero;
+            for (size_t f = 0; f < battlefields; f++)
+            {
+                __m256i mine = _mm256_set1_epi32(di[f]);
+                __m256i theirs = _mm256_loadu_si256((const __m256i*)(w->columns + f * stride + j));
+                __m256i weight = _mm256_set1_epi32(t->weights[f]);
+                margin = _mm256_add_epi32(margin, _mm256_and_si256(_mm256_cmpgt_epi32(mine, theirs), weight));
+                margin = _mm256_sub_epi32(margin, _mm256_and_si256(_mm256_cmpgt_epi32(theirs, mine), weight));
+            }
+
+            // lanes outside [from, nj) get a margin of 0, which counts as nothing
+            __m256i index = _mm256_add_epi32(_mm256_set1_epi32((int)j), lanes);
+            __m256i valid = _mm256_and_si256(_mm256_cmpgt_epi32(index, before), _mm256_cmpgt_epi32(end, index));
+            margin = _mm256_and_si256(margin, valid);
+            __m256i won = _mm256_cmpgt_epi32(margin, zero);
+            __m256i lost = _mm256_cmpgt_epi32(zero, margin);
+
+            // masks are -1 where set, so subtracting them counts
+            sum = _mm256_add_epi32(sum, margin);
+            wins = _mm256_sub_epi32(wins, won);
+            losses = _mm256_sub_epi32(losses, lost);
+            __m256i* their_sums = (__m256i*)(w->sums + j);
+            __m256i* their_wins = (__m256i*)(w->wins + j);
+            __m256i* their_losses = (__m256i*)(w->losses + j);
+            _mm256_storeu_si256(their_sums, _mm256_sub_epi32(_mm256_loadu_si256(their_sums), margin));
+            _mm256_storeu_si256(their_wins, _mm256_sub_epi32(_mm256_loadu_si256(their_wins), lost));
+            _mm256_storeu_si256(their_losses, _mm256_sub_epi32(_mm256_loadu_si256(their_losses), won));
+        }
+
+        int32_t lane_sums[8];
+        int32_t lane_wins[8];
+        int32_t lane_losses[8];
+        _mm256_storeu_si256((__m256i*)lane_sums, sum);
+        _mm256_storeu_si256((__m256i*)lane_wins, wins);
+        _mm256_storeu_si256((__m256i*)lane_losses, losses);
+        tournament_standing* si = &w->standings[i];
+        for (size_t k = 0; k < 8; k++)
+        {
+            si->points2 += lane_sums[k];
+            si->wins += lane_wins[k];
+            si->losses += lane_losses[k];
+        }
+    }
+
+    for (size_t j = 0; j < nj; j++)
+    {
+        tournament_standing* sj = &w->standings[j_start + j];
+        sj->points2 += w->sums[j];
+        sj->wins += w->wins[j];
+        sj->losses += w->losses[j];
+    }
+}
+#endif
+
+/*
+ * Orders standings by wins counting ties as half, then points, both
+ * descending, then by entry.
+ */
+static int tournament_compare(const void* a, const void* b)
+{
+    const tournament_standing* s1 = a;
+    const tournament_standing* s2 = b;
+    size_t half_wins1 = 2 * s1->wins + s1->ties;
+    size_t half_wins2 = 2 * s2->wins + s2->ties;
+    if (half_wins1 != half_wins2)
+        return half_wins1 > half_wins2 ? -1 : 1;
+    if (s1->points2 != s2->points2)
+        return s1->points2 > s2->points2 ? -1 : 1;
+    return (s1->entry > s2->entry) - (s1->entry < s2->entry);
+}
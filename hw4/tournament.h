@@ -0,0 +1,53 @@
+#ifndef __TOURNAMENT_H__
+#define __TOURNAMENT_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * One entry's results over a round-robin tournament.  Points are kept
+ * doubled (see blotto_margin) so that they are exact integers.
+ */
+typedef struct tournament_standing
+{
+    // the entry's row in the distributions passed to tournament_run
+    size_t entry;
+    size_t wins;
+    size_t ties;
+    size_t losses;
+    // twice the battlefield points the entry scored over all its matchups
+    int64_t points2;
+} tournament_standing;
+
+/**
+ * Plays every pair of the given entries against each other once and fills
+ * in each entry's standing.  The distributions are taken as a matrix, one
+ * row per entry, and the pairs are scored a tile of rows against a tile of
+ * rows at a time, so the tiles stay in cache, with the rows of tiles
+ * shared out among worker threads.
+ *
+ * @param distributions a pointer to n rows of battlefields unit counts,
+ * row i for entry i, non-NULL
+ * @param n the number of entries
+ * @param weights a pointer to an array of battlefields weights, non-NULL
+ * @param battlefields the number of battlefields, positive
+ * @param nthreads the most threads to use, counting the calling thread, or
+ * 0 for one per online processor; no more than one per online processor
+ * are used
+ * @param standings a pointer to an array of n standings to fill in, non-NULL
+ * @return true if successful, false if there was an allocation error
+ */
+bool tournament_run(const int *distributions, size_t n, const int *weights, int battlefields,
+                    size_t nthreads, tournament_standing *standings);
+
+/**
+ * Sorts the given standings into ranking order: most wins (a tie counting
+ * half a win) first, then most points, then by entry index.
+ *
+ * @param standings a pointer to an array of n standings, non-NULL
+ * @param n the number of standings
+ */
+void tournament_rank(tournament_standing *standings, size_t n);
+
+#endif